@@ -0,0 +1,82 @@
+/* File: abs_ctrl.c
+ * ----------------
+ * Anti-lock brake force controller, hardware independent (see abs_ctrl.h).
+ */
+
+#include "abs_ctrl.h"
+
+#define KPH_PER_S_Q16_PER_MG  2314      // 1 mg = 9.80665 mm/s^2 = 0.0353 kph/s, Q16
+#define REAPPLY_PROBE_MS      500       // at the cap this long without a lock: try full demand
+
+void abs_ctrl_init(abs_ctrl_t *abs, unsigned int rate_hz) {
+    abs->step_ms = 1000 / rate_hz;
+    abs->phase = ABS_APPLY;
+    abs->force = 0;
+    abs->lock_force = 0;
+    abs->phase_ms = 0;
+    abs->ref_kph_q16 = 0;
+    abs->ref_drop_q16 = (uint32_t)ABS_MAX_DECEL_MG * KPH_PER_S_Q16_PER_MG * abs->step_ms / 1000;
+    abs->apply_step = ABS_APPLY_RATE * abs->step_ms / 1000;
+    abs->reapply_step = ABS_REAPPLY_RATE * abs->step_ms / 1000;
+    abs->lock_events = 0;
+}
+
+static unsigned int min_u(unsigned int a, unsigned int b) {
+    return a < b ? a : b;
+}
+
+static void enter(abs_ctrl_t *abs, abs_phase_t phase) {
+    abs->phase = phase;
+    abs->phase_ms = 0;
+}
+
+/* One control period: returns the force to apply, permille */
+unsigned int abs_ctrl_step(abs_ctrl_t *abs, const abs_input_t *in) {
+    uint32_t rear = in->rear_kph_q16;
+
+    // the bike can't slow faster than ABS_MAX_DECEL_MG, even if the wheel does
+    uint32_t ref = abs->ref_kph_q16;
+    ref = (ref > abs->ref_drop_q16) ? ref - abs->ref_drop_q16 : 0;
+    if (rear > ref) ref = rear;
+    if (in->have_front && in->front_kph_q16 > ref) ref = in->front_kph_q16;
+    abs->ref_kph_q16 = ref;
+
+    unsigned int demand = min_u(in->demand, ABS_FULL_FORCE);
+    if (demand == 0 || ref < ((uint32_t)ABS_MIN_KPH << 16)) {
+        // nothing to modulate: released, or too slow for a lock to matter
+        enter(abs, ABS_APPLY);
+        abs->force = demand;
+        return abs->force;
+    }
+
+    // slip compares (ref - rear) / ref against the limits, cross-multiplied
+    uint64_t shortfall = (uint64_t)(ref - rear) * 1000;
+    bool locking = shortfall > (uint64_t)ref * ABS_SLIP_LOCK_PERMILLE;
+    bool recovered = shortfall <= (uint64_t)ref * ABS_SLIP_RECOVER_PERMILLE;
+    abs->phase_ms += abs->step_ms;
+
+    if (locking && abs->phase != ABS_RELEASE) {
+        abs->lock_force = abs->force;
+        abs->force = abs->force * ABS_RELEASE_PERMILLE / 1000;
+        abs->lock_events++;
+        enter(abs, ABS_RELEASE);
+    }
+
+    switch (abs->phase) {
+        case ABS_APPLY:
+            abs->force = min_u(abs->force + abs->apply_step, demand);
+            break;
+        case ABS_RELEASE:
+            if (recovered && abs->phase_ms >= ABS_RELEASE_MIN_MS) enter(abs, ABS_REAPPLY);
+            break;
+        case ABS_REAPPLY: {
+            unsigned int cap = abs->lock_force * ABS_REAPPLY_CAP_PERMILLE / 1000;
+            abs->force = min_u(abs->force + abs->reapply_step, min_u(cap, demand));
+            // grip may have improved (dry patch): probe upward again
+            if (abs->phase_ms >= REAPPLY_PROBE_MS) enter(abs, ABS_APPLY);
+            break;
+        }
+    }
+    abs->force = min_u(abs->force, demand);
+    return abs->force;
+}
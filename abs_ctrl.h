@@ -0,0 +1,72 @@
+/* File: abs_ctrl.h
+ * ----------------
+ * Anti-lock brake force controller.
+ *
+ * Each step takes the braked (rear) wheel speed, the front wheel speed if
+ * it is sensed, and the brake force the rider/controller asks for, and
+ * returns the force to apply. Forces are permille of full servo travel.
+ *
+ * The controller keeps a vehicle reference speed: the front wheel if there
+ * is one, otherwise the rear speed with its fall limited to what a bike can
+ * do (ABS_MAX_DECEL_MG). A rear wheel that drops well below the reference
+ * (an abrupt jump in Hall period, or rear/front slip) is starting to lock,
+ * so the force is cut back. Once the wheel spins back up the force is
+ * re-applied, more slowly and capped just under the level that locked:
+ *
+ *     APPLY --lock--> RELEASE --recovered--> REAPPLY --lock--> RELEASE ...
+ *
+ * Below ABS_MIN_KPH the demand passes straight through.
+ *
+ * This file has no hardware dependencies so the same controller can run
+ * against a simulated wheel on the host; abs_task.c runs it on the bike.
+ * A step is straight-line integer code: no loops, and divides only by
+ * constants (the compiler turns those into multiplies).
+ */
+
+#ifndef ABS_CTRL_H
+#define ABS_CTRL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ABS_FULL_FORCE               1000
+#define ABS_MIN_KPH                  4
+#define ABS_MAX_DECEL_MG             800     // no real stop is harder than this
+#define ABS_SLIP_LOCK_PERMILLE       200     // wheel this far below reference: locking
+#define ABS_SLIP_RECOVER_PERMILLE    80      // back within this: grip regained
+#define ABS_RELEASE_PERMILLE         300     // force kept on lock, of the force that locked
+#define ABS_REAPPLY_CAP_PERMILLE     900     // reapply up to this much of the locking force
+#define ABS_APPLY_RATE               4000    // force permille per second
+#define ABS_REAPPLY_RATE             1000
+#define ABS_RELEASE_MIN_MS           60      // shortest release, lets the wheel spin up
+
+typedef enum {
+    ABS_APPLY = 0,
+    ABS_RELEASE,
+    ABS_REAPPLY
+} abs_phase_t;
+
+typedef struct {
+    uint32_t rear_kph_q16;          // braked wheel, 0 if stopped
+    uint32_t front_kph_q16;
+    bool have_front;
+    unsigned int demand;            // requested force, permille
+} abs_input_t;
+
+typedef struct {
+    unsigned int step_ms;
+    abs_phase_t phase;
+    unsigned int force;             // output, permille
+    unsigned int lock_force;        // force when the last lock was seen
+    unsigned int phase_ms;
+    uint32_t ref_kph_q16;           // vehicle reference speed
+    uint32_t ref_drop_q16;          // most the reference may fall per step
+    unsigned int apply_step;        // force increase per step
+    unsigned int reapply_step;
+    unsigned int lock_events;
+} abs_ctrl_t;
+
+void abs_ctrl_init(abs_ctrl_t *abs, unsigned int rate_hz);
+unsigned int abs_ctrl_step(abs_ctrl_t *abs, const abs_input_t *in);
+
+#endif /* ABS_CTRL_H */
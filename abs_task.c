@@ -0,0 +1,107 @@
+/* File: abs_task.c
+ * ----------------
+ * Anti-lock controller on the control timer (see abs_task.h).
+ */
+
+#include "abs_task.h"
+#include "brake_actuator.h"
+#include "control_timer.h"
+#include "hall_capture.h"
+#include "road_fft.h"
+#include "speed.h"
+#include "speed_service.h"
+#include "timer.h"
+#include "assert.h"
+#include <stddef.h>
+
+#define STALL_TICKS  ((uint64_t)SPEED_STALL_TIMEOUT_MS * 1000 * TICKS_PER_USEC)
+
+static struct {
+    abs_ctrl_t ctrl;
+    int magnets;
+    volatile unsigned int demand;
+    unsigned int written;           // last force handed to the actuator
+    volatile unsigned int max_ticks;
+    volatile unsigned int overruns;
+} module;
+
+/*
+ * Same bounds as speed_service.c, from the raw edge times: the last gap
+ * scaled to a revolution, or the time since the last edge once that is
+ * longer (the wheel is slower than that), or stopped.
+ */
+static uint32_t wheel_kph_q16(hall_wheel_t wheel, uint64_t now) {
+    uint64_t edge, gap;
+    hall_capture_latest(wheel, &edge, &gap);
+    uint64_t since = now - edge;
+    if (gap == UINT64_MAX || since > STALL_TICKS) return 0;
+    uint64_t period = gap * module.magnets;
+    if (since * module.magnets > period) period = since * module.magnets;
+    return speed_kph_q16(period);
+}
+
+/* Runs every control period in interrupt context */
+static void abs_step(void *aux_data) {
+    unsigned long start = timer_get_ticks();
+
+    unsigned int demand = module.demand;
+    abs_input_t in;
+    in.rear_kph_q16 = wheel_kph_q16(HALL_WHEEL_REAR, start);
+    in.have_front = hall_capture_wheel_enabled(HALL_WHEEL_FRONT);
+    in.front_kph_q16 = in.have_front ? wheel_kph_q16(HALL_WHEEL_FRONT, start) : 0;
+    // less grip on a rough road: ask for less so the ABS has less to catch
+    in.demand = demand * road_brake_scale_permille() / 1000;
+    unsigned int force = abs_ctrl_step(&module.ctrl, &in);
+
+    // only touch the brake while braking, or to let go after
+    if (force != module.written) {
+        brake_actuator_set_force(force);
+        module.written = force;
+    }
+
+    unsigned int elapsed = timer_get_ticks() - start;
+    if (elapsed > module.max_ticks) module.max_ticks = elapsed;
+    if (elapsed > ABS_BUDGET_US * TICKS_PER_USEC) module.overruns++;
+}
+
+/* Requires brake_actuator_init() and the rear Hall capture; magnets per wheel */
+void abs_task_init(unsigned int rate_hz, int magnets) {
+    assert(rate_hz > 0 && 1000000 / CONTROL_TICK_US % rate_hz == 0);
+    assert(magnets >= 1 && magnets <= SPEED_MAX_MAGNETS);
+    abs_ctrl_init(&module.ctrl, rate_hz);
+    module.magnets = magnets;
+    module.demand = 0;
+    module.written = 0;
+    module.max_ticks = 0;
+    module.overruns = 0;
+
+    control_timer_init();
+    bool added = control_timer_add(abs_step, NULL, 1000000 / CONTROL_TICK_US / rate_hz);
+    assert(added);
+}
+
+/* Brake force wanted, permille; the task applies as much of it as the wheel takes */
+void abs_task_set_demand(unsigned int demand_permille) {
+    module.demand = demand_permille;
+}
+
+unsigned int abs_task_force(void) {
+    return module.ctrl.force;
+}
+
+/* True while the controller is backing off or reapplying after a lock */
+bool abs_task_active(void) {
+    return module.ctrl.phase != ABS_APPLY;
+}
+
+unsigned int abs_task_lock_events(void) {
+    return module.ctrl.lock_events;
+}
+
+unsigned int abs_task_max_us(void) {
+    return module.max_ticks / TICKS_PER_USEC;
+}
+
+unsigned int abs_task_overruns(void) {
+    return module.overruns;
+}
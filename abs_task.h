@@ -0,0 +1,40 @@
+/* File: abs_task.h
+ * ----------------
+ * Runs the anti-lock controller (abs_ctrl.h) on the bike.
+ *
+ * A control timer task (see control_timer.h) samples the latest Hall edges
+ * straight from the capture handlers, turns them into wheel speeds, steps
+ * the controller and hands the force to brake_actuator_set_force(). The
+ * main loop only sets the demand:
+ *
+ *     abs_task_set_demand(ABS_FULL_FORCE);    // brake hard, ABS keeps the wheel turning
+ *     abs_task_set_demand(0);                 // let go
+ *
+ * The demand is scaled down on rough roads (road_brake_scale_permille(),
+ * from the road vibration analysis in road_fft.h) before it reaches the
+ * controller.
+ *
+ * Each iteration is timed against ABS_BUDGET_US; abs_task_max_us() and
+ * abs_task_overruns() show how close it comes. While the demand is zero
+ * the task leaves the brake alone, so engage/release from elsewhere
+ * (e.g. the crash latch) are not overridden.
+ */
+
+#ifndef ABS_TASK_H
+#define ABS_TASK_H
+
+#include <stdbool.h>
+#include "abs_ctrl.h"
+
+#define ABS_RATE_HZ      50      // control rate, must divide the control tick rate
+#define ABS_BUDGET_US    50      // per-iteration budget, interrupt context
+
+void abs_task_init(unsigned int rate_hz, int magnets);
+void abs_task_set_demand(unsigned int demand_permille);
+unsigned int abs_task_force(void);
+bool abs_task_active(void);
+unsigned int abs_task_lock_events(void);
+unsigned int abs_task_max_us(void);
+unsigned int abs_task_overruns(void);
+
+#endif /* ABS_TASK_H */
@@ -0,0 +1,140 @@
+/* File: accel_sched.c
+ * -------------------
+ * Adaptive accelerometer sampling rate (see accel_sched.h).
+ */
+
+#include "accel_sched.h"
+#include "timer.h"
+#include "assert.h"
+#include <stddef.h>
+
+#define MSA311_REG_ODR 0x10
+
+static const struct {
+    uint8_t odr;                // REG_ODR value
+    unsigned int period_us;     // 1/ODR
+} rates[ACCEL_RATE_COUNT] = {
+    [ACCEL_RATE_4HZ]   = { 0x02, 256000 },  // 3.9 Hz
+    [ACCEL_RATE_15HZ]  = { 0x04,  64000 },  // 15.63 Hz
+    [ACCEL_RATE_31HZ]  = { 0x05,  32000 },  // 31.25 Hz
+    [ACCEL_RATE_62HZ]  = { 0x06,  16000 },  // 62.5 Hz
+    [ACCEL_RATE_125HZ] = { 0x07,   8000 },  // 125 Hz
+};
+
+static struct {
+    i2c_device_t *dev;
+    accel_rate_t rate, floor;
+    int kph;
+    int mean[3];                // running mean per axis, mg
+    uint32_t var;               // running variance summed over axes, mg^2
+    unsigned long next_due;     // ticks when the next reading is due
+    unsigned long last_busy;    // ticks when target was last >= current rate
+    unsigned long last_ticks;   // timestamp of previous sample in the stream
+    uint32_t seq;
+    bool rate_changed;
+    bool primed;
+} module;
+
+static void apply_rate(accel_rate_t rate) {
+    if (rate == module.rate) return;
+    if (module.dev && !i2c_write_reg(module.dev, MSA311_REG_ODR, rates[rate].odr)) {
+        return; // keep old rate, try again on next sample
+    }
+    module.rate = rate;
+    module.rate_changed = true;
+}
+
+void accel_sched_init(i2c_device_t *dev) {
+    assert(dev != NULL);
+    module.dev = dev;
+    module.rate = ACCEL_RATE_125HZ; // msa311_init() leaves the sensor at 125 Hz
+    module.floor = ACCEL_RATE_4HZ;
+    module.var = 0;
+    module.seq = 0;
+    module.primed = false;
+    module.next_due = module.last_busy = module.last_ticks = timer_get_ticks();
+    apply_rate(ACCEL_RATE_15HZ);
+}
+
+void accel_sched_update_speed(int kph) {
+    module.kph = kph;
+}
+
+/* Lowest rate allowed, e.g. ACCEL_TURN_MIN_RATE while monitoring a turn */
+void accel_sched_set_floor(accel_rate_t floor) {
+    assert(floor < ACCEL_RATE_COUNT);
+    module.floor = floor;
+    if (module.rate < floor) apply_rate(floor);
+}
+
+static accel_rate_t target_rate(void) {
+    accel_rate_t target;
+    if (module.kph <= 1)       target = ACCEL_RATE_4HZ;
+    else if (module.kph <= 8)  target = ACCEL_RATE_15HZ;
+    else if (module.kph <= 12) target = ACCEL_RATE_31HZ;
+    else                       target = ACCEL_RATE_62HZ;
+
+    if (module.var >= (uint32_t)ACCEL_SCHED_BUSY_MG * ACCEL_SCHED_BUSY_MG) {
+        target = ACCEL_RATE_125HZ;
+    } else if (module.var >= (uint32_t)ACCEL_SCHED_ACTIVE_MG * ACCEL_SCHED_ACTIVE_MG
+               && target < ACCEL_RATE_125HZ) {
+        target++;
+    }
+    return (target < module.floor) ? module.floor : target;
+}
+
+static void adapt(unsigned long now) {
+    accel_rate_t target = target_rate();
+    if (target >= module.rate) {
+        module.last_busy = now;
+        apply_rate(target);
+    } else if (now - module.last_busy >= ACCEL_SCHED_HOLD_MS * 1000UL * TICKS_PER_USEC) {
+        module.last_busy = now;
+        apply_rate(module.rate - 1); // step down one level at a time
+    }
+}
+
+bool accel_sched_due(unsigned long now) {
+    return (long)(now - module.next_due) >= 0;
+}
+
+void accel_sched_submit(int x_mg, int y_mg, int z_mg, unsigned long ticks, accel_sample_t *out) {
+    int v[3] = { x_mg, y_mg, z_mg };
+    if (!module.primed) {
+        for (int i = 0; i < 3; i++) module.mean[i] = v[i];
+        module.primed = true;
+    }
+    uint32_t sq = 0;
+    for (int i = 0; i < 3; i++) {
+        int dev = v[i] - module.mean[i];
+        module.mean[i] += dev / 8;
+        sq += (uint32_t)(dev * dev);
+    }
+    module.var = module.var - module.var / 8 + sq / 8;
+
+    out->ticks = ticks;
+    out->dt_ticks = ticks - module.last_ticks;
+    out->seq = module.seq++;
+    out->x_mg = x_mg;
+    out->y_mg = y_mg;
+    out->z_mg = z_mg;
+    out->rate = module.rate;
+    out->rate_changed = module.rate_changed;
+    module.rate_changed = false;
+    module.last_ticks = ticks;
+
+    adapt(ticks);
+    // schedule from the previous deadline so the stream doesn't drift,
+    // unless we've fallen a whole period behind
+    unsigned long period = (unsigned long)rates[module.rate].period_us * TICKS_PER_USEC;
+    module.next_due += period;
+    if ((long)(ticks - module.next_due) >= 0) module.next_due = ticks + period;
+}
+
+accel_rate_t accel_sched_rate(void) {
+    return module.rate;
+}
+
+unsigned int accel_sched_period_us(void) {
+    return rates[module.rate].period_us;
+}
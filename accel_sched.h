@@ -0,0 +1,62 @@
+/* File: accel_sched.h
+ * -------------------
+ * Adaptive sampling rate for the MSA311 accelerometer.
+ *
+ * Instead of a fixed 10 Hz poll, the scheduler picks an output data rate
+ * from the Hall-measured speed and from the variance of recent readings,
+ * reprograms REG_ODR when the rate changes, and tells the caller when the
+ * next reading is due. Rate goes up immediately, and only comes back down
+ * after ACCEL_SCHED_HOLD_MS of calm so it doesn't chatter.
+ *
+ * Every reading that goes through accel_sched_submit() comes back as an
+ * accel_sample_t with a tick timestamp, the time since the previous
+ * sample and a sequence number, so consumers see one consistent stream
+ * across rate changes.
+ *
+ * Turn-detection latency bound: while a turn is being monitored the rate
+ * never drops below ACCEL_RATE_15HZ, and the turn detector consumes one
+ * reading per ACCEL_TURN_PERIOD_MS. Its 10-of-15 window therefore fires
+ * at most 10 * 100 ms + one 64 ms sample period after the turn starts,
+ * the same bound as the old fixed 10 Hz loop.
+ */
+
+#ifndef ACCEL_SCHED_H
+#define ACCEL_SCHED_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "i2c.h"
+
+typedef enum {
+    ACCEL_RATE_4HZ = 0,     // stopped
+    ACCEL_RATE_15HZ,        // slow / straight
+    ACCEL_RATE_31HZ,
+    ACCEL_RATE_62HZ,
+    ACCEL_RATE_125HZ,       // fast or lots of motion
+    ACCEL_RATE_COUNT
+} accel_rate_t;
+
+#define ACCEL_SCHED_HOLD_MS      500    // calm time before stepping the rate down
+#define ACCEL_SCHED_ACTIVE_MG    200    // std-dev that bumps the rate one level
+#define ACCEL_SCHED_BUSY_MG      500    // std-dev that goes straight to the top
+#define ACCEL_TURN_PERIOD_MS     100    // turn detector consumes 10 readings/sec
+#define ACCEL_TURN_MIN_RATE      ACCEL_RATE_15HZ
+
+typedef struct {
+    unsigned long ticks;        // timer ticks when the reading was taken
+    unsigned long dt_ticks;     // ticks since the previous sample in the stream
+    uint32_t seq;               // increments by one per sample
+    int x_mg, y_mg, z_mg;
+    accel_rate_t rate;          // rate in effect when the reading was taken
+    bool rate_changed;          // first sample after a rate change
+} accel_sample_t;
+
+void accel_sched_init(i2c_device_t *dev);
+void accel_sched_update_speed(int kph);
+void accel_sched_set_floor(accel_rate_t floor);
+bool accel_sched_due(unsigned long now);
+void accel_sched_submit(int x_mg, int y_mg, int z_mg, unsigned long ticks, accel_sample_t *out);
+accel_rate_t accel_sched_rate(void);
+unsigned int accel_sched_period_us(void);
+
+#endif /* ACCEL_SCHED_H */
@@ -42,13 +42,30 @@
 #include "interrupts.h"
 #include "ringbuffer.h"
 #include "pwm.h"
-
-#define WHEEL_DIAMETER_IN 26
-#define MS_PER_SEC 1000
-#define SEC_PER_HR 3600
-#define IN_PER_FT 12
-#define FT_PER_KM 3281
-
+#include "hall_capture.h"
+#include "speed.h"
+#include "speed_service.h"
+#include "speed_trend.h"
+#include "trip.h"
+#include "speed_fusion.h"
+#include "brake_actuator.h"
+#include "servo_cal.h"
+#include "blink.h"
+#include "abs_task.h"
+#include "speed_limit.h"
+#include "impact.h"
+#include "road_fft.h"
+#include "accel_sched.h"
+#include "brake_light.h"
+#include "emergency_brake.h"
+#include "vl53l0x.h"
+#include "record_store.h"
+
+#define DISPLAY_REFRESH_MS 250 // redraw rate while no new magnet pass arrives
+#define TOF_FAST_KPH      15    // from here, 20 ms ranging: the gap ahead closes fast
+#define TOF_SLOW_KPH      4     // below, 200 ms ranging: accuracy over rate
+#define TOF_HYSTERESIS_KPH 2
+#define BRAKE_CHECK_TIMEOUT_MS 100 // boot self-test: the pulse lands within two servo frames (40 ms)
 
 /*********************** ACCELOROMETER SENSOR PART BEGINS *********************************/
 
@@ -67,6 +84,12 @@
 #define REG_POWER_MODE  0x11
 #define REG_BANDWIDTH   0x12
 #define REG_RESOLUTION  0x13
+#define REG_INT_SET0    0x16
+#define REG_INT_MAP0    0x19
+#define REG_INT_CONFIG  0x20
+#define REG_INT_LATCH   0x21
+#define REG_ACTIVE_DUR  0x27
+#define REG_ACTIVE_TH   0x28
 
 /* Configuration Values */
 #define FS_2G           0x00
@@ -79,6 +102,12 @@
 #define BANDWIDTH_125HZ 0x07
 #define RESOLUTION_14   0x01
 
+#define ACTIVE_INT_XYZ  0x07    // slope interrupt on all three axes
+#define INT1_ACTIVE     0x04    // route it to INT1
+#define INT1_PUSH_PULL_HIGH 0x01
+#define LATCH_250MS     0x01
+#define MSA311_CRASH_SLOPE_MG 1900  // change between two samples; near the top of the 4 g scale
+
 /* Expected Device ID for MSA311 */
 #define EXPECTED_PART_ID 0x13
 
@@ -97,6 +126,7 @@ static bool set_resolution(msa311_t *msa, uint8_t resolution);
 
 bool msa311_read_raw(msa311_t *msa, int16_t *x_raw, int16_t *y_raw, int16_t *z_raw);
 bool msa311_read_acceleration(msa311_t *msa, int *x_mg, int *y_mg, int *z_mg);
+bool msa311_enable_crash_int(msa311_t *msa, int slope_mg);
 int msa311_calculate_magnitude(int x_mg, int y_mg, int z_mg);
 void msa311_free(msa311_t *msa);
 
@@ -250,6 +280,29 @@ bool msa311_read_acceleration(msa311_t *msa, int *x_mg, int *y_mg, int *z_mg) {
     return true;
 }
 
+/*
+ * Slope interrupt on INT1: raised when consecutive samples on any axis
+ * differ by more than slope_mg, held 250 ms so the edge can't be missed.
+ * The sensor decides on its own, so the crash is seen even while nothing
+ * is reading it (see emergency_brake.h).
+ */
+bool msa311_enable_crash_int(msa311_t *msa, int slope_mg) {
+    int th = slope_mg * 512 / msa->range;   // 1 LSB = range/512 mg
+    if (th < 1) th = 1;
+    if (th > 255) th = 255;
+
+    if (!i2c_write_reg(msa->i2c_dev, REG_ACTIVE_TH, th) ||
+        !i2c_write_reg(msa->i2c_dev, REG_ACTIVE_DUR, 0x00) ||  // one sample over
+        !i2c_write_reg(msa->i2c_dev, REG_INT_CONFIG, INT1_PUSH_PULL_HIGH) ||
+        !i2c_write_reg(msa->i2c_dev, REG_INT_LATCH, LATCH_250MS) ||
+        !i2c_write_reg(msa->i2c_dev, REG_INT_MAP0, INT1_ACTIVE) ||
+        !i2c_write_reg(msa->i2c_dev, REG_INT_SET0, ACTIVE_INT_XYZ)) {
+        printf("Error: Failed to set up the crash interrupt.\n");
+        return false;
+    }
+    return true;
+}
+
 /*
 float simple_sqrtf(float number) {
     if (number < 0) {
@@ -341,8 +394,9 @@ void msa311_free(msa311_t *msa) {
 
 
 
-/* GPIO pin for LED and Button */
-#define LED_PIN GPIO_PB3
+/* Turn signal LED (blinks by PWM, see blink.h) and Button */
+#define LED_CHANNEL PWM7
+#define LED_PIN GPIO_PB10   // PB3 has no PWM function
 #define BUTTON_PIN GPIO_PB4
 
 /* Volatile flags for interrupt synchronization */
@@ -359,29 +413,93 @@ void handle_button_interrupt(void *aux_data) {
 void config_button(void) {
     gpio_set_input(BUTTON_PIN);           // Set button as input
     gpio_set_pullup(BUTTON_PIN);          // Enable internal pull-up resistor
-    gpio_interrupt_init();                // Initialize GPIO interrupt system
     gpio_interrupt_config(BUTTON_PIN, GPIO_INTERRUPT_NEGATIVE_EDGE, true); // Trigger on falling edge
     gpio_interrupt_register_handler(BUTTON_PIN, handle_button_interrupt, NULL); // Register interrupt handler
     gpio_interrupt_enable(BUTTON_PIN);   // Enable interrupt for button pin
 }
 
+/* Trip totals and the servo calibration are kept in the record store (see record_store.h) */
+static bool trip_slot_read(int slot, void *buf, size_t len) {
+    return record_store_read(RECORD_STORE_TRIP, slot, buf, len);
+}
+
+static bool trip_slot_write(int slot, const void *buf, size_t len) {
+    return record_store_write(RECORD_STORE_TRIP, slot, buf, len);
+}
+
+static bool cal_read(void *buf, size_t len) {
+    return record_store_read(RECORD_STORE_SERVO_CAL, 0, buf, len);
+}
+
+static bool cal_write(const void *buf, size_t len) {
+    return record_store_write(RECORD_STORE_SERVO_CAL, 0, buf, len);
+}
+
+static const trip_storage_t trip_storage = { .read = trip_slot_read, .write = trip_slot_write };
+static const servo_cal_storage_t cal_storage = { .read = cal_read, .write = cal_write };
+
+/* True if the button is down at boot: asks for servo calibration */
+static bool button_held_at_boot(void) {
+    gpio_set_input(BUTTON_PIN);
+    gpio_set_pullup(BUTTON_PIN);
+    timer_delay_ms(5);                    // let the pull-up settle
+    return gpio_read(BUTTON_PIN) == 0;    // active low
+}
+
 /* Function to monitor accelerometer readings */
 void monitor_accelerometer(msa311_t *msa) {
     int x_mg, y_mg, z_mg;
     int theta_window[15] = {0}; // Circular buffer to store the last 15 readings
     int window_start = 0;
     int positive_theta_count = 0;
+    unsigned long next_turn_ticks = timer_get_ticks();
+    uint32_t seen_revolutions = 0;
+
+    accel_sched_set_floor(ACCEL_TURN_MIN_RATE); // bounds turn-detection latency
 
     while (reading_accel) {
+        unsigned long now = timer_get_ticks();
+        brake_light_poll(now);
+        if (!accel_sched_due(now)) {
+            timer_delay_us(1000);
+            continue;
+        }
+
         if (msa311_read_acceleration(msa, &x_mg, &y_mg, &z_mg)) {
-            float theta = calculate_theta(x_mg, z_mg);
+            accel_sample_t sample;
+            accel_sched_submit(x_mg, y_mg, z_mg, now, &sample);
+
+            // full-rate consumers
+            speed_service_poll();
+            speed_reading_t reading;
+            speed_service_read(&reading);
+            if (reading.revolutions != seen_revolutions) {
+                // wheel passes cross-check the deceleration, as in the speed stage
+                seen_revolutions = reading.revolutions;
+                brake_light_update_speed(speed_q16_whole(reading.kph_q16), reading.last_edge_ticks);
+            }
+            accel_sched_update_speed(speed_q16_whole(reading.kph_q16)); // picks the next rate
+            speed_fusion_wheel(&reading);
+            speed_fusion_accel(&sample); // speed between passes at the sample rate
+            impact_process_sample(sample.x_mg, sample.y_mg, sample.z_mg, sample.ticks);
+            if (sample.rate_changed) road_fft_restart_block(); // one rate per block
+            road_fft_push(sample.z_mg); // vertical axis carries road vibration
+            brake_light_process_sample(&sample);
+
+            // turn detector keeps its 10 readings/sec regardless of sample rate
+            if ((long)(sample.ticks - next_turn_ticks) < 0) continue;
+            next_turn_ticks = sample.ticks + ACCEL_TURN_PERIOD_MS * 1000UL * TICKS_PER_USEC;
+
+            float theta = calculate_theta(sample.x_mg, sample.z_mg);
             int theta_int = (int)(theta * 100); // Scale to two decimal places
 
-            printf("Theta: %d.%02d degrees | Accel (mg) -> X: %d, Y: %d, Z: %d\n", 
-                   theta_int / 100, custom_abs(theta_int % 100), x_mg, y_mg, z_mg);
+            uint32_t fused_kph_q16 = speed_fusion_kph_q16();
+            printf("Theta: %d.%02d degrees | Accel (mg) -> X: %d, Y: %d, Z: %d | %d.%d kph\n", 
+                   theta_int / 100, custom_abs(theta_int % 100), sample.x_mg, sample.y_mg, sample.z_mg,
+                   speed_q16_whole(fused_kph_q16), speed_q16_tenths(fused_kph_q16));
 
             // Update the sliding window
-            if (theta > 30) {
+            if (theta > road_scale_threshold(30)) { // loosened on rough roads
                 positive_theta_count += 1 - theta_window[window_start];
                 theta_window[window_start] = 1; // Current reading is positive
             } else {
@@ -394,15 +512,30 @@ void monitor_accelerometer(msa311_t *msa) {
 
             // Check if we meet the condition
             if (positive_theta_count >= 10) {
-                gpio_write(LED_PIN, 0); // Turn off LED
+                blink_set(LED_CHANNEL, false); // Turn off LED
                 reading_accel = false; // Stop monitoring
                 break;
             }
         } else {
             printf("Failed to read accelerometer data\n");
         }
+    }
 
-        timer_delay_us(100000); // 100ms delay
+    accel_sched_set_floor(ACCEL_RATE_4HZ);
+    printf("Road FFT: %d blocks, worst %d us (%d over budget)\n",
+           road_fft_features()->blocks, road_fft_max_us(), road_fft_overruns());
+}
+
+/* Impact handler: flash the LEDs and latch the servo brake on a crash */
+void handle_impact(const impact_event_t *evt, void *aux_data) {
+    printf("Impact detected (%s), peak |a|^2: %d mg^2\n",
+           evt->severity == IMPACT_CRASH ? "crash" : "hard", (int)evt->peak_mag_sq);
+
+    blink_start(LED_CHANNEL, &BLINK_ALERT); // returns at once, the PWM times the flashes
+
+    if (evt->severity == IMPACT_CRASH) {
+        brake_actuator_engage(BRAKE_HOLD_UNTIL_RELEASE); // latch the brake
+        reading_accel = false;
     }
 }
 
@@ -410,26 +543,24 @@ void monitor_accelerometer(msa311_t *msa) {
 /*********************** BUTTON & LED PART ENDS *********************************/
 
 
-void main2(void) {
+/* Turn signal stage, on the accelerometer main() brought up */
+void main2(msa311_t *msa) {
     gpio_init();
-    interrupts_init();
 
     // Initialize LED pin
-    gpio_set_output(LED_PIN);
-    gpio_write(LED_PIN, 0); // Turn off LED initially
+    blink_config(LED_CHANNEL, LED_PIN); // starts off
 
     // Configure button with interrupt
     config_button();
 
-    // Initialize accelerometer
-    msa311_t *msa = msa311_init();
     if (!msa) {
         printf("Failed to initialize accelerometer!\n");
         return;
     }
 
-    // Enable global interrupts
-    interrupts_global_enable();
+    // Crash detection runs on every accelerometer reading
+    impact_init(IMPACT_HARD_MG, IMPACT_CRASH_MG);
+    impact_register_handler(handle_impact, NULL);
 
     printf("System initialized. Waiting for button press...\n");
 
@@ -438,7 +569,7 @@ void main2(void) {
             button_pressed = false; // Reset flag
 
             if (!reading_accel) {
-                gpio_write(LED_PIN, 1); // Turn on LED
+                blink_start(LED_CHANNEL, &BLINK_TURN_SIGNAL); // blinks with no CPU
                 reading_accel = true;
                 printf("Button pressed. Monitoring accelerometer...\n");
                 monitor_accelerometer(msa);
@@ -452,6 +583,24 @@ void main2(void) {
     msa311_free(msa);
 }
 
+/* Reads the accelerometer if the scheduler says a sample is due */
+static bool take_accel_sample(msa311_t *msa, accel_sample_t *sample) {
+    unsigned long now = timer_get_ticks();
+    int x_mg, y_mg, z_mg;
+    if (!accel_sched_due(now) || !msa311_read_acceleration(msa, &x_mg, &y_mg, &z_mg)) return false;
+    accel_sched_submit(x_mg, y_mg, z_mg, now, sample);
+    return true;
+}
+
+/* ToF preset for the speed; holds the current one near the edges so it doesn't flip */
+static vl53l0x_preset_t tof_preset_for_speed(unsigned long kph, vl53l0x_preset_t current) {
+    if (kph >= TOF_FAST_KPH) return VL53L0X_HIGH_SPEED;
+    if (kph < TOF_SLOW_KPH) return VL53L0X_HIGH_ACCURACY;
+    if (current == VL53L0X_HIGH_SPEED && kph + TOF_HYSTERESIS_KPH >= TOF_FAST_KPH) return current;
+    if (current == VL53L0X_HIGH_ACCURACY && kph < TOF_SLOW_KPH + TOF_HYSTERESIS_KPH) return current;
+    return VL53L0X_DEFAULT;
+}
+
 void print_magnet(unsigned int val) {
     printf(val ?  "magnet out of range\n" : "magnet detected\n" );
 }
@@ -463,12 +612,49 @@ void main(void) {
     uart_init();
     timer_init();
     pwm_init();
+    brake_light_init();
 
  
-    // set GPIO pin for hall effect
-    const gpio_id_t hall_effect = GPIO_PC1;
-    gpio_set_input(hall_effect);
-  	gpio_set_pullup(hall_effect);
+    // hall effect pulses are timestamped by interrupt (see hall_capture.c)
+    interrupts_init();
+    gpio_interrupt_init();
+    record_store_init();
+    servo_cal_init(); // hand-tuned endpoints until servo_cal_guided() is run, see below
+    servo_cal_set_storage(&cal_storage); // a saved calibration replaces them
+    brake_actuator_init(); // servo brake steps from the control timer interrupt
+    const gpio_id_t hall_effect = HALL_PIN;
+    hall_capture_init(hall_effect);
+    hall_capture_hw_init(); // same Hall output also wired to HALL_CAPTURE_PIN
+    // passes closer than a revolution at SPEED_MAX_KPH are vibration, not the wheel
+    hall_capture_set_filter(HALL_WHEEL_REAR,
+                            SPEED_PERIOD_FOR_KPH(SPEED_MAX_KPH) / TICKS_PER_USEC / SPEED_MAGNETS_PER_WHEEL,
+                            HALL_VOTE_SAMPLES);
+    if (HALL_FRONT_FITTED) {
+        hall_capture_init_wheel(HALL_WHEEL_FRONT, HALL_FRONT_PIN);
+        hall_capture_set_filter(HALL_WHEEL_FRONT,
+                                SPEED_PERIOD_FOR_KPH(SPEED_MAX_KPH) / TICKS_PER_USEC / SPEED_MAGNETS_PER_WHEEL,
+                                HALL_VOTE_SAMPLES);
+    }
+    abs_task_init(ABS_RATE_HZ, SPEED_MAGNETS_PER_WHEEL); // modulates the brake against wheel lock
+    speed_limit_init(SPEED_LIMIT_RATE_HZ, &SPEED_LIMIT_GAINS);
+    // brakes from the Hall interrupt even if this loop is stuck (see emergency_brake.h)
+    emergency_brake_init(EMERGENCY_OVERSPEED_KPH, SPEED_MAGNETS_PER_WHEEL);
+    interrupts_global_enable();
+
+    // hold the button through reset to redo the brake endpoints over the UART
+    if (button_held_at_boot()) {
+        servo_cal_guided(BRAKE_SERVO_CHANNEL);
+        servo_cal_print();
+    }
+
+    // brake check at standstill: fire the emergency path, time it, let go
+    emergency_brake_trigger();
+    unsigned long check_start = timer_get_ticks();
+    while (!emergency_brake_applied() &&
+           timer_get_ticks() - check_start < BRAKE_CHECK_TIMEOUT_MS * 1000UL * TICKS_PER_USEC) ;
+    if (!emergency_brake_applied()) printf("Emergency brake: full-brake pulse not taken within %d ms!\n", BRAKE_CHECK_TIMEOUT_MS);
+    emergency_brake_print();
+    emergency_brake_clear();
 
     // pin is 1 when the magnet is out of range of the sensor
     print_magnet(1);
@@ -483,76 +669,150 @@ void main(void) {
     // display
     gl_swap_buffer();
 
-    bool nextStage = false;
-	while(!nextStage) {
-		unsigned long initial_usecs = timer_get_ticks() / TICKS_PER_USEC; // prev microseconds
-		unsigned long initial_msecs = initial_usecs / 1000; // prev milliseconds
-
-  		while(gpio_read(hall_effect) == 1) {} // wait for low
-		print_magnet(0);
-  		while(gpio_read(hall_effect) == 0) {} // wait for high
-		print_magnet(1);
+    speed_service_init(SPEED_STALL_TIMEOUT_MS, true);
+    // average over one revolution so magnet placement error cancels
+    speed_service_config_wheel(HALL_WHEEL_REAR, SPEED_MAGNETS_PER_WHEEL, SPEED_MAGNETS_PER_WHEEL);
+    if (HALL_FRONT_FITTED) {
+        speed_service_config_wheel(HALL_WHEEL_FRONT, SPEED_MAGNETS_PER_WHEEL, SPEED_MAGNETS_PER_WHEEL);
+    }
+    speed_trend_init();
+    trip_init(SPEED_MAGNETS_PER_WHEEL);
+    trip_set_storage(&trip_storage); // lifetime totals carry on from the last checkpoint
 
-		unsigned long current_usecs = timer_get_ticks() / TICKS_PER_USEC; // cur microseconds 
-		unsigned long current_msecs = current_usecs / 1000; // cur milliseconds
+    i2c_init(); // one bus for the accelerometer and the ToF sensor
 
-		unsigned long ms_elapsed = current_msecs - initial_msecs; // ms elapsed
-		unsigned long seconds_elapsed = ms_elapsed / 1000; // seconds elapsed
+    // accelerometer: brake light deceleration while riding, turn detection after
+    msa311_t *msa = msa311_init();
+    if (msa) {
+        // independently of the main loop, the sensor's slope interrupt brakes at once
+        if (msa311_enable_crash_int(msa, MSA311_CRASH_SLOPE_MG)) emergency_brake_watch_crash(EMERGENCY_CRASH_PIN);
+        road_fft_init();
+        accel_sched_init(msa->i2c_dev);
+        speed_fusion_init();
+    } else {
+        printf("No accelerometer, brake light from wheel speed only\n");
+    }
 
-		// integer precision
-		const unsigned long kph_num = WHEEL_DIAMETER_IN * (22) * MS_PER_SEC * SEC_PER_HR;
-		const unsigned long kph_denom = 7 * ms_elapsed * IN_PER_FT * FT_PER_KM;
-		const unsigned long kph = kph_num / kph_denom;
-		printf("kph: %ld\n\n\n", kph);
+    // optional ToF sensor looking ahead: ranges on its own, GPIO1 says when a sample is in
+    bool tof_ok = vl53l0x_init(VL53L0X_GPIO1_PIN) && vl53l0x_start_continuous();
+    if (!tof_ok) printf("No VL53L0X, riding without range ahead\n");
+    unsigned int ahead_mm = 0;
+    vl53l0x_preset_t tof_preset = VL53L0X_DEFAULT;  // as vl53l0x_init() leaves it
+    uint32_t shown_revolutions = 0;
+    unsigned long last_refresh = timer_get_ticks();
 
-		// 3 decimal precision
-		// const unsigned long kph_x1000 = 1000 * kph_num / kph_denom;
-		// const unsigned long kph_1 = kph_x1000 / 1000;
-		// const unsigned long kph_rest = kph_x1000 % 1000;
-		// printf("kph: %ld.%03ld\n\n\n", kph_1, kph_rest);
+    bool nextStage = false;
+    bool braked = false;
+    bool limiting = false;
+    // hold the bike under the brake band edge for the whole stage (see speed_limit.h)
+    speed_limit_set_ceiling(SPEED_BRAKE_KPH);
+	while(!nextStage) {
+		// never blocks: take whatever pulses arrived, then act on current data
+		speed_service_poll();
+		vl53l0x_sample_t range;
+		if (tof_ok && vl53l0x_read(&range)) ahead_mm = range.valid ? range.range_mm : 0; // I2C only when GPIO1 said so
+		speed_reading_t reading;
+		speed_service_read(&reading);
+		trip_update(&reading);
+		brake_light_poll(reading.now_ticks);
+		accel_sample_t sample;
+		if (msa && take_accel_sample(msa, &sample)) {
+			speed_fusion_wheel(&reading);
+			speed_fusion_accel(&sample); // speed between passes, for the display
+			if (sample.rate_changed) road_fft_restart_block();
+			road_fft_push(sample.z_mg); // roughness softens the brake (see abs_task.h)
+			brake_light_process_sample(&sample);
+		}
+
+		bool new_pass = (reading.revolutions != shown_revolutions);
+		if (!new_pass && reading.now_ticks - last_refresh < DISPLAY_REFRESH_MS * 1000UL * TICKS_PER_USEC) continue;
+		shown_revolutions = reading.revolutions;
+		last_refresh = reading.now_ticks;
+
+		// speed decays between passes and drops to 0 on a stall (see speed_service.c)
+		uint32_t kph_q16 = reading.kph_q16;
+		const unsigned long kph = speed_q16_whole(kph_q16);
+		accel_sched_update_speed(kph);
+		vl53l0x_preset_t want = tof_preset_for_speed(kph, tof_preset);
+		if (tof_ok && want != tof_preset && vl53l0x_set_preset(want)) tof_preset = want; // one register write
+		if (new_pass) {
+			print_magnet(0);
+			printf("kph: %d.%d (glitches rejected: %d)\n\n\n", speed_q16_whole(kph_q16), speed_q16_tenths(kph_q16),
+			       hall_capture_rejected(HALL_WHEEL_REAR));
+			brake_light_update_speed(kph, reading.last_edge_ticks);
+			if (!reading.stopped) speed_trend_add(reading.last_edge_ticks, kph_q16);
+		}
+		if (reading.stopped) speed_trend_reset(); // a restart starts a fresh fit
 
         size_t bufsize = 20;
         char speed_buffer[bufsize];
-        snprintf(speed_buffer, bufsize, "speed: %ld kph", kph);
-
-        // change display based on speed
-        if (kph >= 0 && kph <= 8) {
+        // between passes the fused speed follows braking sooner than the wheel alone
+        uint32_t shown_q16 = msa ? speed_fusion_kph_q16() : kph_q16;
+        snprintf(speed_buffer, bufsize, "speed: %d.%d kph", speed_q16_whole(shown_q16), speed_q16_tenths(shown_q16));
+
+        // change display based on speed band (period compares, see speed.h)
+        speed_band_t band = speed_band(reading.period_ticks);
+        // brake early if speed is climbing fast enough to reach the band soon:
+        // the limiter holds the bike under the ceiling less the expected rise
+        uint32_t lead_q16 = 0;
+        if (speed_trend_valid()) {
+            uint32_t predicted_q16 = speed_trend_predict_kph_q16(SPEED_TREND_HORIZON_MS);
+            if (predicted_q16 >= ((uint32_t)SPEED_BRAKE_KPH << 16)) {
+                band = SPEED_BAND_BRAKE;
+                if (predicted_q16 > kph_q16) lead_q16 = predicted_q16 - kph_q16;
+            }
+        }
+        speed_limit_set_lead(lead_q16);
+        bool was_limiting = limiting;
+        limiting = speed_limit_braking();
+        if (limiting && !was_limiting) {
+            trip_note_brake();
+            braked = true;
+        }
+        if (emergency_brake_cause() != EMERGENCY_NONE) {
+            braked = true;
+            // held until the wheel stops, then handed back
+            if (reading.stopped) emergency_brake_clear();
+        }
+        if (limiting || brake_actuator_busy()) band = SPEED_BAND_BRAKE; // stay red until released
+        if (band == SPEED_BAND_SAFE) {
             gl_clear(gl_color(0, 179, 89)); // green
             gl_draw_string(10, 35, speed_buffer, GL_BLACK);
-            gl_swap_buffer();
-        } else if (kph >= 9 && kph <= 12) {
+        } else if (band == SPEED_BAND_WARN) {
             gl_clear(gl_color(255, 255, 0)); // yellow
             gl_draw_string(10, 35, speed_buffer, GL_BLACK);
             gl_draw_string(30, 75, "SLOW DOWN!", GL_BLACK);
-            gl_swap_buffer();
-        } else if (kph >= 13) {
+        } else if (band == SPEED_BAND_BRAKE) {
             gl_clear(gl_color(255, 51, 0)); // red
             gl_draw_string(10, 35, speed_buffer, GL_BLACK);
             gl_draw_string(35, 75, "BRAKING!", GL_BLACK); // fix aligment
-            gl_swap_buffer();
-
-            // DELAY IN PLACE OF BRAKING MECHANISM
-            timer_delay_ms(5000);
-
-            // Configure PWM channel 4 (PB1) with a 50 Hz frequency (typical for servos)
-            pwm_config_channel(PWM4, GPIO_PB1, 50, false);
-
-            // Move servo to -90 degrees
-            pwm_set_duty(PWM4, 6.5); // Duty cycle for approx. -90 degrees
-            timer_delay_ms(10000);     // Hold for 2 seconds
-
-            // Move servo to +85 degrees
-            pwm_set_duty(PWM4, 9.5); // Duty cycle for approx. +85 degrees
-            timer_delay_ms(2000);     // Hold for 2 seconds
-
-            // resting screen
-            gl_clear(gl_color(102, 255, 255)); // light blue
-            gl_draw_string(10, 35, "PHEW!", GL_BLACK);
-            gl_draw_string(10, 75, "close call...", GL_BLACK); // fix alignment
-            gl_swap_buffer();
-
+        }
+        if (ahead_mm) {
+            char ahead_buffer[bufsize];
+            snprintf(ahead_buffer, bufsize, "ahead: %d cm", ahead_mm / 10);
+            gl_draw_string(10, 110, ahead_buffer, GL_BLACK);
+        }
+        gl_swap_buffer();
+
+        // wheel came to a stop after riding: move on to the turn signal stage
+        if (reading.stopped && reading.revolutions > 1 && !brake_actuator_busy()) {
+            if (braked) {
+                // resting screen
+                gl_clear(gl_color(102, 255, 255)); // light blue
+                gl_draw_string(10, 35, "PHEW!", GL_BLACK);
+                gl_draw_string(10, 75, "close call...", GL_BLACK); // fix alignment
+                gl_swap_buffer();
+            }
             nextStage = true;
         }
 	}
-    main2();
+    speed_limit_set_ceiling(0);
+    speed_limit_set_lead(0);
+    if (tof_ok) vl53l0x_stop();
+    trip_checkpoint();
+    trip_print();
+    printf("ABS: %d lock events, worst step %d us (%d over budget)\n",
+           abs_task_lock_events(), abs_task_max_us(), abs_task_overruns());
+    emergency_brake_print();
+    main2(msa);
 }
\ No newline at end of file
@@ -0,0 +1,47 @@
+/* File: blink.c
+ * -------------
+ * Hardware-timed LED blink patterns (see blink.h).
+ */
+
+#include "blink.h"
+#include "assert.h"
+
+#define STEADY_FREQ  1000    // Hz, for solid on/off between patterns
+
+enum { PATTERN = -1, STEADY_OFF = 0, STEADY_ON = 1 };
+
+static struct {
+    int state[8];               // per channel: what it was last told to do
+} module;
+
+/* Requires pwm_init(); the LED starts off */
+void blink_config(pwm_channel_id_t ch, gpio_id_t pin) {
+    pwm_config_channel(ch, pin, STEADY_FREQ, false);
+    module.state[ch] = STEADY_OFF;
+}
+
+/* Returns at once; replaces whatever the LED was doing */
+void blink_start(pwm_channel_id_t ch, const blink_pattern_t *pattern) {
+    assert(pattern->on_ms <= pattern->period_ms);
+    unsigned long period_us = pattern->period_ms * 1000UL;
+    unsigned long on_us = pattern->on_ms * 1000UL;
+    module.state[ch] = PATTERN;
+    if (pattern->count == BLINK_FOREVER) {
+        pwm_set_period_us(ch, period_us, on_us);
+    } else {
+        pwm_start_pulses(ch, period_us, on_us, pattern->count);
+    }
+}
+
+/* Solid on or off, ending any pattern; returns at once, cheap to call every loop */
+void blink_set(pwm_channel_id_t ch, bool on) {
+    int state = on ? STEADY_ON : STEADY_OFF;
+    if (module.state[ch] == state) return;
+    module.state[ch] = state;
+    pwm_set_steady(ch, STEADY_FREQ, on ? 100 : 0);
+}
+
+/* True once a counted pattern has finished; only meaningful for counted patterns */
+bool blink_done(pwm_channel_id_t ch) {
+    return pwm_pulses_done(ch);
+}
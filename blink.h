@@ -0,0 +1,47 @@
+/* File: blink.h
+ * -------------
+ * LED blink patterns timed by the PWM hardware.
+ *
+ * A pattern is a flash period and on time, repeated forever (turn signal)
+ * or a set number of times (e.g. a triple flash as the brake light comes
+ * on). Blinking runs in PWM continuous mode and counted flashes in PWM
+ * pulse mode (see pwm.h), so once started the hardware times every flash
+ * and no interrupt or polling loop is needed to keep it going.
+ *
+ * Starting a pattern or setting the LED returns at once. The change shows
+ * when the period in progress ends (the PWM's period interrupt applies
+ * it), so the latency is bounded by what the LED was doing: up to 1 ms
+ * from steady on or off, up to one period of the running pattern (667 ms
+ * for the turn signal), none once a counted pattern has finished. Needs
+ * interrupts_init() and interrupts enabled.
+ *
+ * The LED must be on a pin with a PWM function. The channel's pair clock is
+ * divided down for periods over ~0.7 s, which the partner channel then
+ * shares, so keep blinking LEDs off the servo's pair for slow patterns.
+ */
+
+#ifndef BLINK_H
+#define BLINK_H
+
+#include <stdbool.h>
+#include "pwm.h"
+
+typedef struct {
+    unsigned int period_ms;
+    unsigned int on_ms;
+    int count;                  // flashes, BLINK_FOREVER to repeat until stopped
+} blink_pattern_t;
+
+#define BLINK_FOREVER  0
+
+/* Road-legal turn signal: 60-120 flashes/min, here 90 at 50% */
+#define BLINK_TURN_SIGNAL   ((blink_pattern_t){ .period_ms = 667, .on_ms = 333, .count = BLINK_FOREVER })
+#define BLINK_TRIPLE_FLASH  ((blink_pattern_t){ .period_ms = 120, .on_ms = 60, .count = 3 })
+#define BLINK_ALERT         ((blink_pattern_t){ .period_ms = 200, .on_ms = 100, .count = 3 })
+
+void blink_config(pwm_channel_id_t ch, gpio_id_t pin);
+void blink_start(pwm_channel_id_t ch, const blink_pattern_t *pattern);
+void blink_set(pwm_channel_id_t ch, bool on);
+bool blink_done(pwm_channel_id_t ch);
+
+#endif /* BLINK_H */
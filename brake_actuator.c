@@ -0,0 +1,176 @@
+/* File: brake_actuator.c
+ * ----------------------
+ * Servo brake state machine stepped by the control timer (see brake_actuator.h).
+ */
+
+#include "brake_actuator.h"
+#include "control_timer.h"
+#include "servo_cal.h"
+#include "servo_motion.h"
+#include "assert.h"
+#include <stddef.h>
+
+#define STEP_MS  10
+#define ENGAGE_MDEG   (SERVO_CAL_ENGAGE_DEG * 1000)
+#define RELEASE_MDEG  (SERVO_CAL_RELEASE_DEG * 1000)
+
+enum { CMD_NONE = 0, CMD_ENGAGE, CMD_RELEASE, CMD_POSITION };
+
+static struct {
+    volatile brake_state_t state;
+    volatile int command;               // latest command wins
+    volatile unsigned int command_hold_ms;
+    volatile int command_mdeg;          // arm angle for CMD_POSITION
+    unsigned int hold_ms;               // for the current engagement
+    unsigned int elapsed_ms;            // time in the current state
+    volatile unsigned int engagements;
+    volatile bool latched;              // emergency brake owns the arm
+} module;
+
+/* Never waits: the motion profile takes the arm there over the next frames */
+static void move_arm(int angle_mdeg) {
+    if (angle_mdeg != servo_motion_target_mdeg()) servo_motion_move_to(angle_mdeg);
+}
+
+static void enter(brake_state_t state, unsigned int elapsed_ms) {
+    module.state = state;
+    module.elapsed_ms = elapsed_ms;
+}
+
+static void apply_command(void) {
+    int command = module.command;
+    module.command = CMD_NONE;
+    if (module.latched) return;
+    brake_state_t state = module.state;
+
+    if (command == CMD_ENGAGE) {
+        module.hold_ms = module.command_hold_ms;
+        if (state == BRAKE_IDLE || state == BRAKE_RELEASING || state == BRAKE_MODULATING) {
+            move_arm(ENGAGE_MDEG);  // turns back smoothly if mid-release
+            if (state != BRAKE_MODULATING) module.engagements++;
+            enter(BRAKE_ENGAGING, 0);
+        } else if (state == BRAKE_HOLDING) {
+            module.elapsed_ms = 0;  // restart the hold
+        }
+    } else if (command == CMD_RELEASE) {
+        if (state == BRAKE_ENGAGING || state == BRAKE_HOLDING || state == BRAKE_MODULATING) {
+            move_arm(RELEASE_MDEG);
+            enter(BRAKE_RELEASING, 0);
+        }
+    } else if (command == CMD_POSITION) {
+        move_arm(module.command_mdeg);
+        if (state == BRAKE_IDLE) module.engagements++;
+        if (state != BRAKE_MODULATING) enter(BRAKE_MODULATING, 0);
+    }
+}
+
+/* Runs every STEP_MS in interrupt context */
+static void brake_step(void *aux_data) {
+    if (module.command != CMD_NONE) apply_command();
+    module.elapsed_ms += STEP_MS;
+
+    switch (module.state) {
+        case BRAKE_ENGAGING:
+            if (servo_motion_reached()) enter(BRAKE_HOLDING, 0);
+            break;
+        case BRAKE_HOLDING:
+            if (module.hold_ms != BRAKE_HOLD_UNTIL_RELEASE && module.elapsed_ms >= module.hold_ms) {
+                move_arm(RELEASE_MDEG);
+                enter(BRAKE_RELEASING, 0);
+            }
+            break;
+        case BRAKE_RELEASING:
+            if (servo_motion_reached()) enter(BRAKE_IDLE, 0);
+            break;
+        case BRAKE_MODULATING:
+        case BRAKE_IDLE:
+            break;
+    }
+}
+
+/* Requires pwm_init(), interrupts_init() and servo_cal_init(); starts the control timer if nobody has yet */
+void brake_actuator_init(void) {
+    module.state = BRAKE_IDLE;
+    module.command = CMD_NONE;
+    module.elapsed_ms = 0;
+    module.engagements = 0;
+    module.latched = false;
+    pwm_config_channel(BRAKE_SERVO_CHANNEL, BRAKE_SERVO_PIN, BRAKE_SERVO_FREQ, false);
+    servo_motion_init(BRAKE_SERVO_CHANNEL, RELEASE_MDEG);
+
+    control_timer_init();
+    bool added = control_timer_add(brake_step, NULL, CONTROL_MS_TO_TICKS(STEP_MS));
+    assert(added);
+}
+
+/* Starts braking and returns at once; hold_ms 0 holds until brake_actuator_release() */
+void brake_actuator_engage(unsigned int hold_ms) {
+    module.command_hold_ms = hold_ms;
+    module.command = CMD_ENGAGE;    // published after the hold time
+}
+
+void brake_actuator_release(void) {
+    module.command = CMD_RELEASE;
+}
+
+/*
+ * Proportional braking: 0 = released, 1000 = fully engaged, anything in
+ * between moves the servo that far along its calibrated travel. Takes
+ * effect on the next step; callers modulating the brake (ABS, speed
+ * limiter) call this at their own rate. 0 releases and returns to idle
+ * after the travel time.
+ */
+void brake_actuator_set_force(unsigned int force_permille) {
+    if (force_permille == 0) {
+        module.command = CMD_RELEASE;
+        return;
+    }
+    if (force_permille > 1000) force_permille = 1000;
+    // degrees * permille is thousandths of a degree
+    module.command_mdeg = RELEASE_MDEG + (SERVO_CAL_ENGAGE_DEG - SERVO_CAL_RELEASE_DEG) * (int)force_permille;
+    module.command = CMD_POSITION;  // published after the angle
+}
+
+/* Arm to a calibrated angle (see servo_cal.h), held like a graded force */
+void brake_actuator_set_angle(int angle_deg) {
+    module.command_mdeg = angle_deg * 1000;
+    module.command = CMD_POSITION;
+}
+
+/*
+ * For the emergency path, in interrupt context, once it has written full
+ * brake to the PWM: the arm is at ENGAGE and held there, whatever the
+ * commands, until brake_actuator_unlatch().
+ */
+void brake_actuator_latch(void) {
+    brake_state_t state = module.state;
+    if (state == BRAKE_IDLE || state == BRAKE_RELEASING) module.engagements++;
+    module.latched = true;
+    module.command = CMD_NONE;
+    module.hold_ms = BRAKE_HOLD_UNTIL_RELEASE;
+    enter(BRAKE_HOLDING, 0);
+    servo_motion_set_position(ENGAGE_MDEG);
+}
+
+/* Commands work again; the arm stays put until the next one */
+void brake_actuator_unlatch(void) {
+    module.latched = false;
+}
+
+bool brake_actuator_latched(void) {
+    return module.latched;
+}
+
+brake_state_t brake_actuator_state(void) {
+    return module.state;
+}
+
+/* True from an engage command until the servo is back at rest */
+bool brake_actuator_busy(void) {
+    int command = module.command;
+    return command == CMD_ENGAGE || command == CMD_POSITION || module.state != BRAKE_IDLE;
+}
+
+unsigned int brake_actuator_engagements(void) {
+    return module.engagements;
+}
@@ -0,0 +1,64 @@
+/* File: brake_actuator.h
+ * ----------------------
+ * Non-blocking servo brake.
+ *
+ * The brake is a state machine stepped from the control timer interrupt
+ * (see control_timer.h):
+ *
+ *     IDLE --engage--> ENGAGING --travel--> HOLDING --hold/release--> RELEASING --travel--> IDLE
+ *
+ * brake_actuator_engage() and brake_actuator_release() only record the
+ * command, so they return at once; the interrupt starts the arm moving and
+ * times the hold. The arm travels on a motion profile (see servo_motion.h),
+ * and ENGAGING/RELEASING end when it arrives. An engage while releasing
+ * turns smoothly back to ENGAGING, a release while engaging goes straight
+ * to RELEASING.
+ *
+ * For graded braking, brake_actuator_set_force() puts the servo part way
+ * along its travel (MODULATING) instead, or brake_actuator_set_angle() at
+ * an arm angle; a new one mid-move retargets the profile. Pulse widths come
+ * from the servo calibration tables (see servo_cal.h) and are posted to the
+ * PWM without waiting (see pwm_post_pulse_us()). Everything else (speed,
+ * display, turn signals) keeps running meanwhile.
+ *
+ * The emergency brake (see emergency_brake.h) writes full brake to the PWM
+ * itself and then calls brake_actuator_latch(): the state goes to HOLDING
+ * and every command is ignored until brake_actuator_unlatch().
+ */
+
+#ifndef BRAKE_ACTUATOR_H
+#define BRAKE_ACTUATOR_H
+
+#include <stdbool.h>
+#include "pwm.h"
+
+/* Hardware: servo on PWM4/PB1 at 50 Hz (see servo_motor_control.h) */
+#define BRAKE_SERVO_CHANNEL     PWM4
+#define BRAKE_SERVO_PIN         GPIO_PB1
+#define BRAKE_SERVO_FREQ        50
+// engaged/released positions: SERVO_CAL_ENGAGE_DEG/RELEASE_DEG through the calibration
+
+#define BRAKE_HOLD_MS           10000   // default hold before auto release
+#define BRAKE_HOLD_UNTIL_RELEASE 0      // hold_ms value: wait for brake_actuator_release()
+
+typedef enum {
+    BRAKE_IDLE = 0,
+    BRAKE_ENGAGING,
+    BRAKE_HOLDING,
+    BRAKE_RELEASING,
+    BRAKE_MODULATING        // graded force from brake_actuator_set_force()
+} brake_state_t;
+
+void brake_actuator_init(void);
+void brake_actuator_engage(unsigned int hold_ms);
+void brake_actuator_release(void);
+void brake_actuator_set_force(unsigned int force_permille);
+void brake_actuator_set_angle(int angle_deg);
+void brake_actuator_latch(void);
+void brake_actuator_unlatch(void);
+bool brake_actuator_latched(void);
+brake_state_t brake_actuator_state(void);
+bool brake_actuator_busy(void);
+unsigned int brake_actuator_engagements(void);
+
+#endif /* BRAKE_ACTUATOR_H */
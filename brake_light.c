@@ -0,0 +1,153 @@
+/* File: brake_light.c
+ * -------------------
+ * Automatic brake light from deceleration (see brake_light.h).
+ *
+ * The forward axis reads gravity plus mounting tilt at rest, so the
+ * detector tracks a slow baseline of it (frozen while braking) and treats
+ * baseline - reading as deceleration, smoothed with a short filter.
+ */
+
+#include "brake_light.h"
+#include "blink.h"
+#include "timer.h"
+
+#define TICKS_PER_MS (1000UL * TICKS_PER_USEC)
+#define SPEED_DROP_WINDOW_MS 1000
+
+static struct {
+    int baseline_q4;            // slow average of forward axis, mg << 4
+    int decel;                  // filtered deceleration, mg
+    int over;                   // consecutive readings above threshold
+    bool primed;
+    int last_kph;
+    unsigned long last_kph_ticks;
+    unsigned long speed_drop_ticks; // when the Hall speed last dropped
+    bool speed_dropping;
+    bool on;
+    bool flashing;              // onset flashes still running in hardware
+    unsigned long last_trigger; // ticks when an on-condition last held
+} module;
+
+static void set_steady(int duty) {
+    pwm_set_steady(BRAKE_LIGHT_CHANNEL, BRAKE_LIGHT_FREQ, duty);   // back from blink timing, no wait
+}
+
+/* Coming on, the light flashes (hardware timed) and then stays on */
+static void set_light(bool on) {
+    if (on == module.on) return;
+    module.on = on;
+    module.flashing = on;
+    if (on) {
+        blink_start(BRAKE_LIGHT_CHANNEL, &BRAKE_LIGHT_ONSET_PATTERN);
+    } else {
+        set_steady(BRAKE_LIGHT_TAIL_DUTY);
+    }
+}
+
+static void check_flashing(void) {
+    if (module.flashing && blink_done(BRAKE_LIGHT_CHANNEL)) {
+        module.flashing = false;
+        set_steady(BRAKE_LIGHT_ON_DUTY);
+    }
+}
+
+void brake_light_init(void) {
+    pwm_init();
+    pwm_config_channel(BRAKE_LIGHT_CHANNEL, BRAKE_LIGHT_PIN, BRAKE_LIGHT_FREQ, false);
+    pwm_set_duty(BRAKE_LIGHT_CHANNEL, BRAKE_LIGHT_TAIL_DUTY);
+    module.on = false;
+    module.flashing = false;
+    module.primed = false;
+    module.over = 0;
+    module.speed_dropping = false;
+    module.last_kph = -1;
+}
+
+static bool speed_recently_dropped(unsigned long now) {
+    if (module.speed_dropping && now - module.speed_drop_ticks > SPEED_DROP_WINDOW_MS * TICKS_PER_MS) {
+        module.speed_dropping = false;  // drop window over
+    }
+    return module.speed_dropping;
+}
+
+/* Off once neither source has called for the light for BRAKE_LIGHT_HOLD_MS */
+static void check_release(unsigned long now) {
+    if (module.on && module.decel < BRAKE_LIGHT_OFF_MG && !speed_recently_dropped(now)
+        && now - module.last_trigger >= BRAKE_LIGHT_HOLD_MS * TICKS_PER_MS) {
+        set_light(false);
+    }
+}
+
+static void trigger(unsigned long now) {
+    module.last_trigger = now;
+    set_light(true);
+}
+
+void brake_light_process_sample(const accel_sample_t *sample) {
+    check_flashing();
+    int axes[3] = { sample->x_mg, sample->y_mg, sample->z_mg };
+    int forward = BRAKE_LIGHT_AXIS_SIGN * axes[BRAKE_LIGHT_AXIS];
+
+    if (!module.primed) {
+        module.baseline_q4 = forward * 16;
+        module.decel = 0;
+        module.primed = true;
+        return;
+    }
+
+    int decel = (module.baseline_q4 >> 4) - forward;
+    module.decel += (decel - module.decel) / 2;
+    if (!module.on) {
+        module.baseline_q4 += (forward * 16 - module.baseline_q4) / 64;
+    }
+
+    bool confirmed = speed_recently_dropped(sample->ticks);
+    int threshold = confirmed ? BRAKE_LIGHT_ON_MG : BRAKE_LIGHT_HARD_MG;
+    module.over = (module.decel >= threshold) ? module.over + 1 : 0;
+
+    if (module.over >= BRAKE_LIGHT_ONSET_SAMPLES) {
+        trigger(sample->ticks);
+    } else if (module.on && module.decel >= BRAKE_LIGHT_OFF_MG) {
+        module.last_trigger = sample->ticks; // still decelerating, extend hold
+    } else {
+        check_release(sample->ticks);
+    }
+}
+
+/* Called once per wheel revolution with the Hall speed */
+void brake_light_update_speed(int kph, unsigned long ticks) {
+    check_flashing();
+    if (module.last_kph >= 0 && ticks - module.last_kph_ticks <= SPEED_DROP_WINDOW_MS * TICKS_PER_MS) {
+        int drop = module.last_kph - kph;
+        if (drop > 0) {
+            module.speed_dropping = true;
+            module.speed_drop_ticks = ticks;
+        }
+        if (drop >= BRAKE_LIGHT_DROP_KPH) {
+            trigger(ticks);
+        }
+    }
+    module.last_kph = kph;
+    module.last_kph_ticks = ticks;
+    check_release(ticks);
+}
+
+/*
+ * Call often from the main loop: ends the onset flashes and lets the
+ * light go once the hold has run out, even if no sample or wheel pass
+ * comes in (e.g. the wheel has stopped).
+ */
+void brake_light_poll(unsigned long ticks) {
+    check_flashing();
+    check_release(ticks);
+}
+
+/* Puts the light back as this module last set it, after something else drove it (emergency_brake.c) */
+void brake_light_refresh(void) {
+    if (module.flashing) return;    // the pattern's end sets it
+    set_steady(module.on ? BRAKE_LIGHT_ON_DUTY : BRAKE_LIGHT_TAIL_DUTY);
+}
+
+bool brake_light_is_on(void) {
+    return module.on;
+}
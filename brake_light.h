@@ -0,0 +1,65 @@
+/* File: brake_light.h
+ * -------------------
+ * Automatic brake light driven by deceleration.
+ *
+ * Deceleration is read from the accelerometer's forward axis on the same
+ * sample stream the turn detector uses (no extra I2C reads) and
+ * cross-checked against the Hall-sensor speed: a hard deceleration lights
+ * the LED on its own, a moderate one only when the wheel speed is also
+ * dropping. The LED is driven through the PWM driver.
+ *
+ * Latency: the light turns on BRAKE_LIGHT_ONSET_SAMPLES readings after the
+ * filtered deceleration crosses threshold. For a deceleration at least 15%
+ * over threshold the filter crosses within three readings, so onset to
+ * light is at most 4 sample periods: 64 ms at 62.5 Hz, 128 ms at 31 Hz
+ * (the rate accel_sched uses above 8 kph) and 256 ms at 15.6 Hz. The PWM
+ * adds at most 1 ms to that: the light comes on from the steady tail
+ * light, and a change shows when the 1 kHz period in progress ends (see
+ * blink.h). Going off waits at most for the period of the onset flash in
+ * progress, 120 ms.
+ *
+ * The light comes on with BRAKE_LIGHT_ONSET_PATTERN, timed by the PWM
+ * (see blink.h); the next sample, speed update or poll after it ends
+ * switches to steady on. It goes back to the dim tail light once neither
+ * source has called for it for BRAKE_LIGHT_HOLD_MS. Either source can let
+ * it go, so feed both from the same loop: brake_light_process_sample()
+ * per accelerometer sample, brake_light_update_speed() per wheel pass,
+ * and brake_light_poll() every time round.
+ */
+
+#ifndef BRAKE_LIGHT_H
+#define BRAKE_LIGHT_H
+
+#include <stdbool.h>
+#include "pwm.h"
+#include "accel_sched.h"
+#include "blink.h"
+
+/* Hardware: PWM3 on PB0 (PWM4/5 pair is used by the servo) */
+#define BRAKE_LIGHT_CHANNEL      PWM3
+#define BRAKE_LIGHT_PIN          GPIO_PB0
+#define BRAKE_LIGHT_FREQ         1000       // Hz, well above visible flicker
+#define BRAKE_LIGHT_ON_DUTY      100
+#define BRAKE_LIGHT_TAIL_DUTY    10         // dim running light when not braking
+#define BRAKE_LIGHT_ONSET_PATTERN BLINK_TRIPLE_FLASH // then steady on
+
+/* Mounting: which axis points forward, and its sign */
+#define BRAKE_LIGHT_AXIS         0          // 0 = x, 1 = y, 2 = z
+#define BRAKE_LIGHT_AXIS_SIGN    1
+
+/* Thresholds (100 mg ~ 1 m/s^2) */
+#define BRAKE_LIGHT_HARD_MG      250        // lights without Hall confirmation
+#define BRAKE_LIGHT_ON_MG        100        // lights if speed is also dropping
+#define BRAKE_LIGHT_OFF_MG       50
+#define BRAKE_LIGHT_DROP_KPH     3          // Hall-only trigger: drop per pulse within 1 s
+#define BRAKE_LIGHT_ONSET_SAMPLES 2
+#define BRAKE_LIGHT_HOLD_MS      300        // minimum on time, avoids flicker
+
+void brake_light_init(void);
+void brake_light_process_sample(const accel_sample_t *sample);
+void brake_light_update_speed(int kph, unsigned long ticks);
+void brake_light_poll(unsigned long ticks);
+void brake_light_refresh(void);
+bool brake_light_is_on(void);
+
+#endif /* BRAKE_LIGHT_H */
@@ -0,0 +1,20 @@
+/* File: checksum.h
+ * ----------------
+ * Checksums for the small records kept in persistent storage (trip.h,
+ * servo_cal.h).
+ *
+ * A record carries its own 16-bit checksum; checksum_record() computes it
+ * with that field read as zero, so the same call both fills the field
+ * before a write and checks it after a read.
+ */
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+uint16_t fletcher16(const void *buf, size_t len);
+uint16_t checksum_record(const void *rec, size_t len, size_t checksum_offset);
+
+#endif /* CHECKSUM_H */
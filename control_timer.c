@@ -0,0 +1,63 @@
+/* File: control_timer.c
+ * ---------------------
+ * Periodic control tick on HSTIMER0 (see control_timer.h).
+ */
+
+#include "control_timer.h"
+#include "hstimer.h"
+#include "interrupts.h"
+#include "assert.h"
+#include <stddef.h>
+
+static struct {
+    struct {
+        control_task_fn_t fn;
+        void *aux_data;
+        unsigned int period;
+        unsigned int countdown;
+    } tasks[CONTROL_MAX_TASKS];
+    volatile int ntasks;
+    volatile uint32_t ticks;
+    bool initialized;
+} module;
+
+static void handle_tick(void *aux_data) {
+    hstimer_interrupt_clear(HSTIMER0);
+    module.ticks++;
+    for (int i = 0; i < module.ntasks; i++) {
+        if (--module.tasks[i].countdown == 0) {
+            module.tasks[i].countdown = module.tasks[i].period;
+            module.tasks[i].fn(module.tasks[i].aux_data);
+        }
+    }
+}
+
+void control_timer_init(void) {
+    if (module.initialized) return;
+    module.ntasks = 0;
+    module.ticks = 0;
+    hstimer_init(HSTIMER0, CONTROL_TICK_US);
+    interrupts_register_source(INTERRUPT_SOURCE_HSTIMER0, handle_tick, NULL);
+    interrupts_enable_source(INTERRUPT_SOURCE_HSTIMER0);
+    hstimer_enable(HSTIMER0);
+    module.initialized = true;
+}
+
+/* Calls fn every period_ticks ticks from the timer interrupt; false if the table is full */
+bool control_timer_add(control_task_fn_t fn, void *aux_data, unsigned int period_ticks) {
+    assert(module.initialized);
+    assert(fn != NULL && period_ticks >= 1);
+    int n = module.ntasks;
+    if (n == CONTROL_MAX_TASKS) return false;
+    module.tasks[n].fn = fn;
+    module.tasks[n].aux_data = aux_data;
+    module.tasks[n].period = period_ticks;
+    module.tasks[n].countdown = period_ticks;
+    module.ntasks = n + 1;  // publish only after the entry is filled in
+    return true;
+}
+
+/* Ticks since control_timer_init(), wraps after ~49 days */
+uint32_t control_timer_ticks(void) {
+    return module.ticks;
+}
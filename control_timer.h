@@ -0,0 +1,32 @@
+/* File: control_timer.h
+ * ---------------------
+ * Periodic control tick on a hardware timer interrupt.
+ *
+ * HSTIMER0 interrupts every CONTROL_TICK_US. Modules that need to act on
+ * time without the main loop waiting for them (servo brake, motion ramps)
+ * register a task with its own period in ticks; the interrupt handler
+ * counts each task down and calls it when due. Tasks run in interrupt
+ * context, so they must be short and must not wait.
+ *
+ * Call interrupts_init() before control_timer_init() and
+ * interrupts_global_enable() after.
+ */
+
+#ifndef CONTROL_TIMER_H
+#define CONTROL_TIMER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CONTROL_TICK_US      1000   // 1 kHz
+#define CONTROL_MAX_TASKS    8
+
+#define CONTROL_MS_TO_TICKS(ms)  ((ms) * 1000 / CONTROL_TICK_US)
+
+typedef void (*control_task_fn_t)(void *aux_data);
+
+void control_timer_init(void);
+bool control_timer_add(control_task_fn_t fn, void *aux_data, unsigned int period_ticks);
+uint32_t control_timer_ticks(void);
+
+#endif /* CONTROL_TIMER_H */
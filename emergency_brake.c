@@ -0,0 +1,154 @@
+/* File: emergency_brake.c
+ * -----------------------
+ * Overspeed and crash braking from interrupt context (see emergency_brake.h).
+ */
+
+#include "emergency_brake.h"
+#include "brake_actuator.h"
+#include "brake_light.h"
+#include "hall_capture.h"
+#include "servo_cal.h"
+#include "speed.h"
+#include "gpio_extra.h"
+#include "gpio_interrupt.h"
+#include "interrupts.h"
+#include "timer.h"
+#include "printf.h"
+#include "assert.h"
+#include <stdint.h>
+#include <stddef.h>
+
+static struct {
+    volatile emergency_cause_t cause;   // NONE until fired, until cleared
+    uint64_t overspeed_ticks;           // magnet-to-magnet period at the overspeed
+    int short_edges;                    // short periods in a row
+    uint64_t trigger_ticks;
+    uint32_t seq;                       // PWM group commit of the full-brake pulse
+    volatile bool pending;              // waiting for the PWM to take it
+    volatile bool applied;
+    volatile unsigned int firings;
+    volatile unsigned int max_post_us;
+    volatile unsigned int max_change_us;
+} module;
+
+/*
+ * Straight to the PWM: no motion profile, no state machine step, nothing
+ * that waits. The full-brake pulse and the brake light go out in one group
+ * commit, so the light comes on with the brake. Interrupt context only
+ * (they don't nest, so no other handler posts in between).
+ */
+static void fire(emergency_cause_t cause, uint64_t trigger_ticks) {
+    if (module.cause != EMERGENCY_NONE) return;     // already braking
+    pwm_group_stage_pulse_us(BRAKE_SERVO_CHANNEL, servo_cal_angle_us(SERVO_CAL_ENGAGE_DEG));
+    pwm_group_stage_duty_fraction(BRAKE_LIGHT_CHANNEL, BRAKE_LIGHT_ON_DUTY, 100);
+    module.seq = pwm_group_commit(EMERGENCY_PWM_GROUP);
+    unsigned int post_us = (timer_get_ticks() - trigger_ticks) / TICKS_PER_USEC;
+
+    module.cause = cause;
+    module.trigger_ticks = trigger_ticks;
+    module.pending = true;
+    module.applied = false;
+    module.firings++;
+    if (post_us > module.max_post_us) module.max_post_us = post_us;
+    brake_actuator_latch();
+}
+
+/* Hall handler hook, on every accepted edge */
+static void check_overspeed(hall_wheel_t wheel, uint64_t edge_ticks, uint64_t period_ticks, void *aux_data) {
+    if (wheel != HALL_WHEEL_REAR) return;
+    if (period_ticks >= module.overspeed_ticks) {
+        module.short_edges = 0;
+        return;
+    }
+    if (++module.short_edges >= EMERGENCY_CONFIRM_EDGES) fire(EMERGENCY_OVERSPEED, edge_ticks);
+}
+
+static void handle_crash_pin(void *aux_data) {
+    uint64_t now = timer_get_ticks();   // stamp first, before anything else
+    gpio_id_t pin = (gpio_id_t)(uintptr_t)aux_data;
+    gpio_interrupt_clear(pin);
+    fire(EMERGENCY_CRASH, now);
+}
+
+/* PWM period interrupt, on every value the brake channel takes: times the full-brake pulse reaching the pin */
+static void handle_commit(pwm_channel_id_t ch, uint32_t seq, void *aux_data) {
+    if (!module.pending || !pwm_group_done(EMERGENCY_PWM_GROUP, module.seq)) return;
+    unsigned int change_us = (timer_get_ticks() - module.trigger_ticks) / TICKS_PER_USEC;
+    if (change_us > module.max_change_us) module.max_change_us = change_us;
+    module.pending = false;
+    module.applied = true;
+}
+
+/* Fires after EMERGENCY_CONFIRM_EDGES rear passes faster than overspeed_kph */
+void emergency_brake_init(unsigned int overspeed_kph, int magnets) {
+    assert(overspeed_kph > 0 && magnets > 0);
+    module.cause = EMERGENCY_NONE;
+    module.overspeed_ticks = SPEED_PERIOD_FOR_KPH(overspeed_kph) / magnets;
+    module.short_edges = 0;
+    module.pending = false;
+    module.applied = false;
+    module.firings = 0;
+    module.max_post_us = 0;
+    module.max_change_us = 0;
+
+    // brake_actuator_init() already deferred the channel; this adds the handler
+    pwm_defer_enable(BRAKE_SERVO_CHANNEL, handle_commit, NULL);
+    pwm_group_config(EMERGENCY_PWM_GROUP, (1 << BRAKE_SERVO_CHANNEL) | (1 << BRAKE_LIGHT_CHANNEL));
+    hall_capture_set_edge_hook(check_overspeed, NULL);
+}
+
+/*
+ * Fires on a rising edge on pin, wired to the accelerometer's INT1 with
+ * its slope interrupt set up (see msa311_enable_crash_int() in bike_demo.c).
+ */
+void emergency_brake_watch_crash(gpio_id_t pin) {
+    gpio_set_input(pin);
+    gpio_set_pulldown(pin);     // quiet if the accelerometer isn't fitted
+    gpio_interrupt_config(pin, GPIO_INTERRUPT_POSITIVE_EDGE, false);
+    gpio_interrupt_register_handler(pin, handle_crash_pin, (void *)(uintptr_t)pin);
+    gpio_interrupt_enable(pin);
+}
+
+/* Fires from the main loop, e.g. for a bench check of the latency */
+void emergency_brake_trigger(void) {
+    interrupts_global_disable();    // as if in a handler
+    fire(EMERGENCY_MANUAL, timer_get_ticks());
+    interrupts_global_enable();
+}
+
+/* Lets go: the actuator takes commands again and releases the arm, the brake light goes back to its own state */
+void emergency_brake_clear(void) {
+    module.short_edges = 0;
+    module.cause = EMERGENCY_NONE;
+    brake_actuator_unlatch();
+    brake_actuator_release();
+    brake_light_refresh();
+}
+
+emergency_cause_t emergency_brake_cause(void) {
+    return module.cause;
+}
+
+/* True once the full-brake pulse from the latest firing is on the pin */
+bool emergency_brake_applied(void) {
+    return module.applied;
+}
+
+unsigned int emergency_brake_firings(void) {
+    return module.firings;
+}
+
+/* Worst edge-to-PWM-commit time so far, microseconds: the work in the handler */
+unsigned int emergency_brake_max_post_us(void) {
+    return module.max_post_us;
+}
+
+/* Worst edge-to-new-pulse time so far, microseconds */
+unsigned int emergency_brake_max_change_us(void) {
+    return module.max_change_us;
+}
+
+void emergency_brake_print(void) {
+    printf("Emergency brake: %d firings, worst edge to PWM commit %d us, to new servo pulse %d us\n",
+           emergency_brake_firings(), emergency_brake_max_post_us(), emergency_brake_max_change_us());
+}
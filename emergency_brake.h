@@ -0,0 +1,78 @@
+/* File: emergency_brake.h
+ * -----------------------
+ * Emergency brake that doesn't depend on the main loop.
+ *
+ * The speed limiter works from speed_service readings, which only move
+ * when the main loop polls; while the loop is stuck in a printf, an I2C
+ * wait or gl_swap_buffer() nothing brakes. This path decides and acts in
+ * interrupt context instead:
+ *
+ *  - overspeed: the Hall edge handler calls back on every accepted edge
+ *    (see hall_capture_set_edge_hook()); EMERGENCY_CONFIRM_EDGES periods
+ *    in a row shorter than the overspeed period fire it;
+ *  - crash: the accelerometer's own slope interrupt on its INT1 pin,
+ *    watched by emergency_brake_watch_crash(), fires it.
+ *
+ * Firing commits the calibrated full-brake pulse to the servo PWM and full
+ * on to the brake light as one PWM group (EMERGENCY_PWM_GROUP, see
+ * pwm_group_commit()) right in the handler, then latches the brake
+ * actuator (brake_actuator_latch()) so nothing else moves the arm until
+ * emergency_brake_clear(), which also hands the light back to brake_light.
+ *
+ * Worst-case latency, triggering edge to the new pulse on the servo pin:
+ *
+ *  1. getting into the handler: interrupts don't nest, so up to the
+ *     longest handler already running, a control tick with the ABS step
+ *     (ABS_BUDGET_US) and the other tasks or a Hall vote (about 20 usec);
+ *  2. the check and the commit: about a microsecond;
+ *  3. the PWM: the group restarts on its new values at the end of the
+ *     servo's current 20 ms frame. The restart reloads the period, so a
+ *     motion profile update already in flight doesn't add a frame.
+ *
+ * So at most one servo frame (20 ms) plus well under a millisecond, and
+ * the servo reads its pulse once a frame anyway. The brake light comes on
+ * on the same edge. For a crash add the accelerometer's detection: one
+ * sample at 125 Hz plus the slope duration.
+ *
+ * Each firing is measured from the edge stamp (taken first thing in the
+ * handler, so (1) isn't in it): to the return of the commit, which is (2)
+ * only, and to the PWM commit handler for the brake channel, which runs
+ * in the period interrupt that restarts the group, so (2) and (3). The
+ * worst of each is kept for emergency_brake_print(). emergency_brake_trigger()
+ * fires from software for a bench check of (2) and (3).
+ *
+ * Call after brake_actuator_init(), brake_light_init() and
+ * hall_capture_init(), before interrupts_global_enable(). Takes the brake
+ * channel's commit handler and PWM group EMERGENCY_PWM_GROUP.
+ */
+
+#ifndef EMERGENCY_BRAKE_H
+#define EMERGENCY_BRAKE_H
+
+#include <stdbool.h>
+#include "gpio.h"
+
+#define EMERGENCY_OVERSPEED_KPH  25     // well past the limiter's SPEED_BRAKE_KPH
+#define EMERGENCY_CONFIRM_EDGES  2      // short periods in a row before firing
+#define EMERGENCY_CRASH_PIN      GPIO_PB2   // MSA311 INT1, active high
+#define EMERGENCY_PWM_GROUP      0          // brake servo and brake light
+
+typedef enum {
+    EMERGENCY_NONE = 0,
+    EMERGENCY_OVERSPEED,
+    EMERGENCY_CRASH,
+    EMERGENCY_MANUAL        // emergency_brake_trigger()
+} emergency_cause_t;
+
+void emergency_brake_init(unsigned int overspeed_kph, int magnets);
+void emergency_brake_watch_crash(gpio_id_t pin);
+void emergency_brake_trigger(void);
+void emergency_brake_clear(void);
+emergency_cause_t emergency_brake_cause(void);
+bool emergency_brake_applied(void);
+unsigned int emergency_brake_firings(void);
+unsigned int emergency_brake_max_post_us(void);
+unsigned int emergency_brake_max_change_us(void);
+void emergency_brake_print(void);
+
+#endif /* EMERGENCY_BRAKE_H */
@@ -12,17 +12,15 @@
 #include "assert.h"
 #include "fb.h"
 #include "gl.h"
+#include "interrupts.h"
+#include "gpio_interrupt.h"
+#include "hall_capture.h"
+#include "speed.h"
 
 /* LIBRARIES FOR MOTOR BEGIN */
 #include "pwm.h"
 /* LIBRARIES FOR MOTOR END */
 
-#define WHEEL_DIAMETER_IN 26
-#define MS_PER_SEC 1000
-#define SEC_PER_HR 3600
-#define IN_PER_FT 12
-#define FT_PER_KM 3281
-
 void print_magnet(unsigned int val) {
     printf(val ?  "magnet out of range\n" : "magnet detected\n" );
 }
@@ -37,10 +35,12 @@ void main(void) {
     pwm_init();
 
  
-    // set GPIO pin for hall effect
-    const gpio_id_t hall_effect = GPIO_PC1;
-    gpio_set_input(hall_effect);
-  	gpio_set_pullup(hall_effect);
+    // hall effect pulses are timestamped by interrupt (see hall_capture.c)
+    interrupts_init();
+    gpio_interrupt_init();
+    const gpio_id_t hall_effect = HALL_PIN;
+    hall_capture_init(hall_effect);
+    interrupts_global_enable();
 
     // pin is 1 when the magnet is out of range of the sensor
     print_magnet(1);
@@ -55,50 +55,45 @@ void main(void) {
     // display
     gl_swap_buffer();
 
+    uint64_t prev_pass = 0;
+    bool have_prev = false;
+
     bool nextStage = false;
 	while(!nextStage) {
-		unsigned long initial_usecs = timer_get_ticks() / TICKS_PER_USEC; // prev microseconds
-		unsigned long initial_msecs = initial_usecs / 1000; // prev milliseconds
-
-  		while(gpio_read(hall_effect) == 1) {} // wait for low
+		uint64_t pass_ticks;
+		if (!hall_capture_pop(&pass_ticks)) continue; // no new pulse, loop stays free for other work
 		print_magnet(0);
-  		while(gpio_read(hall_effect) == 0) {} // wait for high
-		print_magnet(1);
-
-		unsigned long current_usecs = timer_get_ticks() / TICKS_PER_USEC; // cur microseconds 
-		unsigned long current_msecs = current_usecs / 1000; // cur milliseconds
 
-		unsigned long ms_elapsed = current_msecs - initial_msecs; // ms elapsed
-		unsigned long seconds_elapsed = ms_elapsed / 1000; // seconds elapsed
+		if (!have_prev) { // one revolution is the time between two passes
+			prev_pass = pass_ticks;
+			have_prev = true;
+			continue;
+		}
 
-		// integer precision
-		const unsigned long kph_num = WHEEL_DIAMETER_IN * (22) * MS_PER_SEC * SEC_PER_HR;
-		const unsigned long kph_denom = 7 * ms_elapsed * IN_PER_FT * FT_PER_KM;
-		const unsigned long kph = kph_num / kph_denom;
-		printf("kph: %ld\n\n\n", kph);
+		unsigned long period_ticks = pass_ticks - prev_pass;
+		prev_pass = pass_ticks;
 
-		// 3 decimal precision
-		// const unsigned long kph_x1000 = 1000 * kph_num / kph_denom;
-		// const unsigned long kph_1 = kph_x1000 / 1000;
-		// const unsigned long kph_rest = kph_x1000 % 1000;
-		// printf("kph: %ld.%03ld\n\n\n", kph_1, kph_rest);
+		// fixed-point speed straight from the period, no division (see speed.c)
+		uint32_t kph_q16 = speed_kph_q16(period_ticks);
+		printf("kph: %d.%d\n\n\n", speed_q16_whole(kph_q16), speed_q16_tenths(kph_q16));
 
         size_t bufsize = 20;
         char speed_buffer[bufsize];
-        snprintf(speed_buffer, bufsize, "speed: %ld kph", kph);
+        snprintf(speed_buffer, bufsize, "speed: %d.%d kph", speed_q16_whole(kph_q16), speed_q16_tenths(kph_q16));
 
-        // change display based on speed
-        if (kph >= 0 && kph <= 8) {
+        // change display based on speed band (period compares, see speed.h)
+        speed_band_t band = speed_band(period_ticks);
+        if (band == SPEED_BAND_SAFE) {
             gl_clear(gl_color(0, 179, 89)); // green
             gl_draw_string(10, 35, speed_buffer, GL_BLACK);
             gl_swap_buffer();
-        } else if (kph >= 9 && kph <= 12) {
+        } else if (band == SPEED_BAND_WARN) {
             gl_clear(gl_color(255, 255, 0)); // yellow
             gl_draw_string(10, 35, speed_buffer, GL_BLACK);
             gl_draw_string(30, 75, "SLOW DOWN!", GL_BLACK);
             gl_swap_buffer();
 
-        } else if (kph >= 13) {
+        } else if (band == SPEED_BAND_BRAKE) {
             gl_clear(gl_color(255, 51, 0)); // red
             gl_draw_string(10, 35, speed_buffer, GL_BLACK);
             gl_draw_string(35, 75, "BRAKING!", GL_BLACK); // fix aligment
@@ -25,6 +25,11 @@
 #include "uart.h"
 #include "printf.h"
 #include "timer.h"
+#include "interrupts.h"
+#include "gpio_interrupt.h"
+#include "hall_capture.h"
+#include "speed.h"
+#include "speed_service.h"
 
 void print_magnet(unsigned int val) {
    printf(val ?  "magnet out of range\n" : "magnet detected\n" );
@@ -33,12 +38,7 @@ void print_magnet(unsigned int val) {
 void get_speed(void) {
    const gpio_id_t pin = GPIO_PB4;
 
-   const unsigned long wheel_diameter_in = 26;
-
-   const unsigned long ms_per_sec = 1000;
-   const unsigned long sec_per_hr = 3600;
-   const unsigned long in_per_ft = 12;
-   const unsigned long ft_per_mi = 5280;
+   // wheel size lives in speed.h (WHEEL_DIAMETER_IN)
 
    // gpio_init();
    // uart_init();
@@ -46,44 +46,50 @@ void get_speed(void) {
    // // initialize timer
    // timer_init();
 
-   gpio_set_input(pin);
-   gpio_set_pullup(pin);
+   // edges are timestamped by interrupt, see hall_capture.c
+   // (interrupts_init/gpio_interrupt_init must have been called)
+   hall_capture_init(pin);
+   interrupts_global_enable();
 
    // pin is 1 when the magnet is out of range of the sensor
    print_magnet(1);
 
-   while(1) {
-       unsigned long initial_usecs = timer_get_ticks() / TICKS_PER_USEC; // prev microseconds
-       unsigned long initial_msecs = initial_usecs / 1000; // prev milliseconds
+   // polled, never waited on: a wheel that doesn't turn reads as stopped
+   uint64_t prev_pass = 0;
+   bool have_pass = false;   // first pass only starts the clock
+   bool stalled = false;
+   unsigned long last_seen = timer_get_ticks();
 
-       while(gpio_read(pin) == 1) {} // wait for low
+   while(1) {
+       uint64_t pass_ticks;
+       if (!hall_capture_pop(&pass_ticks)) { // nothing new yet
+           if (!stalled && timer_get_ticks() - last_seen >= SPEED_STALL_TIMEOUT_MS * 1000UL * TICKS_PER_USEC) {
+               printf("mph: 0 (no pass in %d ms)\n\n\n", SPEED_STALL_TIMEOUT_MS);
+               stalled = true;
+               have_pass = false;    // the next period would span the stop
+           }
+           continue;
+       }
+       last_seen = timer_get_ticks();
+       stalled = false;
+       if (!have_pass) {
+           prev_pass = pass_ticks;
+           have_pass = true;
+           continue;
+       }
        print_magnet(0);
-       while(gpio_read(pin) == 0) {} // wait for high
-       print_magnet(1);
 
-       unsigned long current_usecs = timer_get_ticks() / TICKS_PER_USEC; // cur microseconds 
-       unsigned long current_msecs = current_usecs / 1000; // cur milliseconds
-
-       unsigned long ms_elapsed = current_msecs - initial_msecs; // ms elapsed
-       unsigned long seconds_elapsed = ms_elapsed / 1000; // seconds elapsed
+       unsigned long period_ticks = pass_ticks - prev_pass;
+       prev_pass = pass_ticks;
 
+       unsigned long ms_elapsed = period_ticks / TICKS_PER_USEC / 1000; // ms elapsed (debug print only)
        printf("millseconds elapsed: %ld\n", ms_elapsed); // print ms elapsed
-       printf("seconds elapsed: %ld\n", seconds_elapsed); // print seconds elapsed
        printf("\n");
 
-       // speed in in / millsecond
-       const unsigned long mph_num = wheel_diameter_in * (22) * ms_per_sec * sec_per_hr;
-       const unsigned long mph_denom = 7 * ms_elapsed * in_per_ft * ft_per_mi;
-
-       // integer precision
-       // const unsigned long mph = mph_num / mph_denom;
-       // printf("mph: %ld\n\n\n", mph);
-
-       // 3 decimal precision
-       const unsigned long mph_x1000 = 1000 * mph_num / mph_denom;
-       const unsigned long mph_1 = mph_x1000 / 1000;
-       const unsigned long mph_rest = mph_x1000 % 1000;
-       printf("mph_COMPARE: %ld\n", mph_x1000);
-       printf("mph: %ld.%03ld\n\n\n", mph_1, mph_rest);
+       // Q16 mph straight from the period (see speed.c)
+       const uint32_t mph_q16 = speed_mph_q16(period_ticks);
+       const unsigned int mph_1 = speed_q16_whole(mph_q16);
+       const unsigned int mph_rest = ((mph_q16 & 0xffff) * 1000) >> 16; // 3 decimal precision
+       printf("mph: %d.%03d\n\n\n", mph_1, mph_rest);
    }
 }
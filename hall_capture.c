@@ -0,0 +1,191 @@
+/* File: hall_capture.c
+ * --------------------
+ * Interrupt-driven Hall pulse capture with a timestamp queue (see hall_capture.h).
+ */
+
+#include "hall_capture.h"
+#include "gpio_extra.h"
+#include "gpio_interrupt.h"
+#include "timer.h"
+#include "assert.h"
+#include <stddef.h>
+
+#define QUEUE_MASK (HALL_QUEUE_LEN - 1)
+_Static_assert((HALL_QUEUE_LEN & QUEUE_MASK) == 0, "HALL_QUEUE_LEN must be a power of two");
+
+typedef struct {
+    gpio_id_t pin;
+    volatile uint64_t queue[HALL_QUEUE_LEN];
+    volatile unsigned int head;     // written only by the interrupt handler
+    volatile unsigned int tail;     // written only by the consumer
+    volatile unsigned int dropped;
+    volatile unsigned int rejected; // edges the glitch filter threw away
+    volatile unsigned int accepted;
+    unsigned long min_gap_ticks;    // edges closer than this to the last one are glitches
+    int vote_samples;               // 0 or odd: pin reads that must mostly be low
+    volatile uint64_t last_edge;    // last accepted edge
+    volatile uint64_t last_period;  // software period, used to vet hardware capture
+    bool enabled;
+} wheel_queue_t;
+
+static struct {
+    wheel_queue_t wheels[HALL_WHEEL_COUNT];
+    volatile hall_edge_fn_t edge_hook;
+    void *edge_hook_aux;
+} module;
+
+/*
+ * A real pass holds the output low for milliseconds, so right after the
+ * edge most of a few reads HALL_VOTE_SPACING_US apart should see low. A
+ * spike from vibration or ignition noise is already gone. At most
+ * HALL_MAX_VOTE_SAMPLES reads, so the cost per edge is bounded.
+ */
+static bool vote_low(const wheel_queue_t *w) {
+    int low = 0;
+    for (int i = 0; i < w->vote_samples; i++) {
+        if (i) timer_delay_us(HALL_VOTE_SPACING_US);
+        if (gpio_read(w->pin) == 0) low++;
+    }
+    return 2 * low > w->vote_samples;
+}
+
+static void handle_hall_edge(void *aux_data) {
+    uint64_t now = timer_get_ticks();   // stamp first, before anything else
+    wheel_queue_t *w = aux_data;
+    gpio_interrupt_clear(w->pin);
+
+    // no wheel turns faster than min_gap allows: anything closer is a glitch
+    if (w->accepted && now - w->last_edge < w->min_gap_ticks) {
+        w->rejected++;
+        return;
+    }
+    if (w->vote_samples && !vote_low(w)) {
+        w->rejected++;
+        return;
+    }
+    w->accepted++;
+    w->last_period = now - w->last_edge;
+    w->last_edge = now;
+    if (module.edge_hook) module.edge_hook(w - module.wheels, now, w->last_period, module.edge_hook_aux);
+
+    unsigned int head = w->head;
+    if (head - w->tail == HALL_QUEUE_LEN) {
+        w->dropped++;
+        return;
+    }
+    w->queue[head & QUEUE_MASK] = now;
+    w->head = head + 1;     // publish only after the slot is written
+}
+
+void hall_capture_init_wheel(hall_wheel_t wheel, gpio_id_t pin) {
+    assert(wheel < HALL_WHEEL_COUNT);
+    wheel_queue_t *w = &module.wheels[wheel];
+    w->pin = pin;
+    w->head = w->tail = 0;
+    w->dropped = 0;
+    w->rejected = 0;
+    w->accepted = 0;
+    w->min_gap_ticks = (unsigned long)HALL_GLITCH_MIN_GAP_US * TICKS_PER_USEC;
+    w->vote_samples = HALL_VOTE_SAMPLES;
+    w->last_edge = timer_get_ticks();
+    w->last_period = UINT64_MAX;
+    w->enabled = true;
+
+    gpio_set_input(pin);
+    gpio_set_pullup(pin);   // output is open-collector, 1 when magnet out of range
+    // no hardware debounce: it would delay the edge time; glitches are filtered in software
+    gpio_interrupt_config(pin, GPIO_INTERRUPT_NEGATIVE_EDGE, false);
+    gpio_interrupt_register_handler(pin, handle_hall_edge, w);
+    gpio_interrupt_enable(pin);
+}
+
+void hall_capture_init(gpio_id_t pin) {
+    hall_capture_init_wheel(HALL_WHEEL_REAR, pin);
+}
+
+/*
+ * min_gap_us: shortest possible magnet-to-magnet time, i.e. one revolution
+ * at top speed divided by magnets per wheel. vote_samples: 0 to disable the
+ * majority vote, otherwise an odd count up to HALL_MAX_VOTE_SAMPLES.
+ */
+void hall_capture_set_filter(hall_wheel_t wheel, unsigned int min_gap_us, int vote_samples) {
+    assert(wheel < HALL_WHEEL_COUNT);
+    assert(vote_samples == 0 || (vote_samples % 2 == 1 && vote_samples <= HALL_MAX_VOTE_SAMPLES));
+    wheel_queue_t *w = &module.wheels[wheel];
+    w->min_gap_ticks = (unsigned long)min_gap_us * TICKS_PER_USEC;
+    w->vote_samples = vote_samples;
+}
+
+/* fn is called from the handler on each accepted edge, before it is queued; NULL to remove */
+void hall_capture_set_edge_hook(hall_edge_fn_t fn, void *aux_data) {
+    module.edge_hook = NULL;    // never seen half-set by the handler
+    module.edge_hook_aux = aux_data;
+    module.edge_hook = fn;
+}
+
+/*
+ * Time and spacing of the newest accepted edge, straight from the handler's
+ * state, so it is current even if nobody has drained the queue. For use from
+ * other interrupt handlers (they don't nest, so the pair is consistent).
+ */
+void hall_capture_latest(hall_wheel_t wheel, uint64_t *edge_ticks, uint64_t *period_ticks) {
+    assert(wheel < HALL_WHEEL_COUNT);
+    const wheel_queue_t *w = &module.wheels[wheel];
+    *edge_ticks = w->last_edge;
+    *period_ticks = w->last_period;
+}
+
+unsigned int hall_capture_rejected(hall_wheel_t wheel) {
+    assert(wheel < HALL_WHEEL_COUNT);
+    return module.wheels[wheel].rejected;
+}
+
+bool hall_capture_wheel_enabled(hall_wheel_t wheel) {
+    return wheel < HALL_WHEEL_COUNT && module.wheels[wheel].enabled;
+}
+
+/* Oldest pending pulse timestamp; false if queue is empty */
+bool hall_capture_pop_wheel(hall_wheel_t wheel, uint64_t *ticks) {
+    wheel_queue_t *w = &module.wheels[wheel];
+    unsigned int tail = w->tail;
+    if (tail == w->head) return false;
+    *ticks = w->queue[tail & QUEUE_MASK];
+    w->tail = tail + 1;     // release the slot only after reading it
+    return true;
+}
+
+bool hall_capture_pop(uint64_t *ticks) {
+    return hall_capture_pop_wheel(HALL_WHEEL_REAR, ticks);
+}
+
+int hall_capture_count(void) {
+    wheel_queue_t *w = &module.wheels[HALL_WHEEL_REAR];
+    return w->head - w->tail;
+}
+
+unsigned int hall_capture_dropped(void) {
+    unsigned int total = 0;
+    for (int i = 0; i < HALL_WHEEL_COUNT; i++) {
+        total += module.wheels[i].dropped;
+    }
+    return total;
+}
+
+void hall_capture_hw_init(void) {
+    pwm_init();
+    pwm_capture_config(HALL_CAPTURE_CHANNEL, HALL_CAPTURE_PIN, HALL_CAPTURE_MAX_PERIOD_US);
+}
+
+/* Hardware-latched rear pass-to-pass period in timer ticks; false if none new or out of range */
+bool hall_capture_hw_period(unsigned long *period_ticks) {
+    unsigned long hw;
+    if (!pwm_capture_read_period(HALL_CAPTURE_CHANNEL, &hw)) return false;
+    // software period is jittery but can't wrap: past the capture range
+    // the 16-bit counter has wrapped and the hardware value is garbage
+    const wheel_queue_t *w = &module.wheels[HALL_WHEEL_REAR];
+    if (w->last_period > (uint64_t)HALL_CAPTURE_MAX_PERIOD_US * TICKS_PER_USEC) return false;
+    // the capture unit sees glitches too; they latch an impossibly short period
+    if (hw < w->min_gap_ticks) return false;
+    *period_ticks = hw;
+    return true;
+}
@@ -0,0 +1,88 @@
+/* File: hall_capture.h
+ * --------------------
+ * Interrupt-driven capture of Hall-effect wheel pulses.
+ *
+ * The Hall output goes low when the magnet passes the sensor. Each falling
+ * edge raises a GPIO interrupt whose handler stamps it with the 64-bit
+ * timer tick count and pushes it onto a single-producer/single-consumer
+ * queue. Nothing blocks waiting for the wheel: whoever needs speed pops the
+ * timestamps and works from the intervals between them.
+ *
+ * The queue is lock-free: only the handler writes head and only the
+ * consumer writes tail. If the consumer falls HALL_QUEUE_LEN pulses behind,
+ * new pulses are dropped and counted.
+ *
+ * Before an edge is queued it must pass a glitch filter: it has to come at
+ * least a minimum gap after the last accepted edge (closer would mean the
+ * wheel is spinning faster than any bike can), and optionally a majority
+ * of a few quick pin reads must still see the magnet. Both checks are
+ * constant time in the handler; rejected edges are counted per wheel so
+ * vibration can't turn into phantom overspeed without leaving a trace.
+ *
+ * Up to HALL_WHEEL_COUNT wheels can be sensed, each with its own pin and
+ * queue (the handler finds its wheel through aux_data). hall_capture_init()
+ * and hall_capture_pop() are shorthand for the rear wheel, which is the
+ * one that must be fitted. bike_demo.c brings up the front one on
+ * HALL_FRONT_PIN when HALL_FRONT_FITTED is set; until then the slip ratio
+ * (speed_service_slip_permille()) is never available.
+ *
+ * A hook set with hall_capture_set_edge_hook() is called from the handler
+ * on every accepted edge, for checks that can't wait for the consumer
+ * (see emergency_brake.h). It runs in interrupt context and must be short.
+ *
+ * Call interrupts_init() and gpio_interrupt_init() before hall_capture_init(),
+ * and interrupts_global_enable() after.
+ *
+ * Optionally, the rear Hall output can also be wired to HALL_CAPTURE_PIN,
+ * where the PWM capture unit latches the edge-to-edge time in hardware. That
+ * period is free of interrupt latency jitter and has ~11 usec resolution;
+ * hall_capture_hw_period() returns it, cross-checked against the software
+ * timestamps so a wrapped 16-bit capture counter (wheel slower than
+ * HALL_CAPTURE_MAX_PERIOD_US) is never reported.
+ */
+
+#ifndef HALL_CAPTURE_H
+#define HALL_CAPTURE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "gpio.h"
+#include "pwm.h"
+
+#define HALL_PIN         GPIO_PC1   // rear wheel
+#define HALL_FRONT_PIN   GPIO_PC0   // optional front wheel
+#define HALL_FRONT_FITTED 0         // 1 with a sensor on HALL_FRONT_PIN: slip ratio for ABS
+#define HALL_QUEUE_LEN   32     // must be a power of two
+
+#define HALL_GLITCH_MIN_GAP_US  10000   // 26" wheel, 8 magnets: ~93 kph
+#define HALL_VOTE_SAMPLES       3       // default majority vote, 0 = off
+#define HALL_MAX_VOTE_SAMPLES   9
+#define HALL_VOTE_SPACING_US    2
+
+#define HALL_CAPTURE_CHANNEL       PWM1
+#define HALL_CAPTURE_PIN           GPIO_PB6
+#define HALL_CAPTURE_MAX_PERIOD_US 700000   // 26" wheel at ~10.7 kph
+
+typedef enum {
+    HALL_WHEEL_REAR = 0,
+    HALL_WHEEL_FRONT,
+    HALL_WHEEL_COUNT
+} hall_wheel_t;
+
+typedef void (*hall_edge_fn_t)(hall_wheel_t wheel, uint64_t edge_ticks, uint64_t period_ticks, void *aux_data);
+
+void hall_capture_init(gpio_id_t pin);
+void hall_capture_init_wheel(hall_wheel_t wheel, gpio_id_t pin);
+void hall_capture_set_filter(hall_wheel_t wheel, unsigned int min_gap_us, int vote_samples);
+void hall_capture_set_edge_hook(hall_edge_fn_t fn, void *aux_data);
+bool hall_capture_wheel_enabled(hall_wheel_t wheel);
+bool hall_capture_pop(uint64_t *ticks);
+bool hall_capture_pop_wheel(hall_wheel_t wheel, uint64_t *ticks);
+void hall_capture_latest(hall_wheel_t wheel, uint64_t *edge_ticks, uint64_t *period_ticks);
+int hall_capture_count(void);
+unsigned int hall_capture_dropped(void);
+unsigned int hall_capture_rejected(hall_wheel_t wheel);
+void hall_capture_hw_init(void);
+bool hall_capture_hw_period(unsigned long *period_ticks);
+
+#endif /* HALL_CAPTURE_H */
@@ -0,0 +1,97 @@
+/* File: impact.c
+ * --------------
+ * Crash and hard-impact detection using squared magnitude (see impact.h).
+ *
+ * Hot path per sample: one ring buffer store plus impact_magnitude_sq() and
+ * a compare. The pre-event history is only unrolled into the event record
+ * on the (rare) trigger, and the handler is only called once the post-event
+ * window is full.
+ */
+
+#include "impact.h"
+#include "assert.h"
+
+#define PRE_MASK (IMPACT_PRE_SAMPLES - 1)
+_Static_assert((IMPACT_PRE_SAMPLES & PRE_MASK) == 0, "IMPACT_PRE_SAMPLES must be a power of two");
+_Static_assert(IMPACT_POST_SAMPLES >= IMPACT_PRE_SAMPLES, "post window refills the history on re-arm");
+
+static struct {
+    uint32_t hard_sq, crash_sq;     // thresholds squared once at init
+    impact_sample_t history[IMPACT_PRE_SAMPLES];
+    unsigned int head;              // next history slot to write
+    int n_post;                     // -1 while armed, else post samples collected
+    impact_event_t event;
+    impact_handler_t handler;
+    void *aux_data;
+} module = {
+    .n_post = -1,
+};
+
+void impact_init(int hard_mg, int crash_mg) {
+    assert(hard_mg > 0 && hard_mg <= crash_mg);
+    module.hard_sq = (uint32_t)hard_mg * (uint32_t)hard_mg;
+    module.crash_sq = (uint32_t)crash_mg * (uint32_t)crash_mg;
+    module.head = 0;
+    module.n_post = -1;
+    for (int i = 0; i < IMPACT_PRE_SAMPLES; i++) {
+        module.history[i] = (impact_sample_t){0};
+    }
+}
+
+void impact_register_handler(impact_handler_t fn, void *aux_data) {
+    module.handler = fn;
+    module.aux_data = aux_data;
+}
+
+bool impact_in_progress(void) {
+    return module.n_post >= 0;
+}
+
+static impact_severity_t classify(uint32_t mag_sq) {
+    if (mag_sq >= module.crash_sq) return IMPACT_CRASH;
+    if (mag_sq >= module.hard_sq) return IMPACT_HARD;
+    return IMPACT_NONE;
+}
+
+/* Copy the ring buffer into the event, oldest sample first */
+static void begin_event(impact_severity_t severity, uint32_t mag_sq, unsigned long ticks) {
+    for (int i = 0; i < IMPACT_PRE_SAMPLES; i++) {
+        module.event.pre[i] = module.history[(module.head + i) & PRE_MASK];
+    }
+    module.event.severity = severity;
+    module.event.ticks = ticks;
+    module.event.peak_mag_sq = mag_sq;
+    module.n_post = 0;
+}
+
+/* Returns severity of this sample alone (IMPACT_NONE for ordinary readings) */
+impact_severity_t impact_process_sample(int x_mg, int y_mg, int z_mg, unsigned long ticks) {
+    uint32_t mag_sq = impact_magnitude_sq(x_mg, y_mg, z_mg);
+    impact_sample_t s = { .x_mg = x_mg, .y_mg = y_mg, .z_mg = z_mg };
+
+    if (module.n_post < 0) {
+        module.history[module.head] = s;
+        module.head = (module.head + 1) & PRE_MASK;
+        if (mag_sq < module.hard_sq) return IMPACT_NONE; // common case ends here
+        impact_severity_t severity = classify(mag_sq);
+        begin_event(severity, mag_sq, ticks);
+        return severity;
+    }
+
+    // collecting post-event window, escalate if a later reading is worse
+    impact_severity_t severity = classify(mag_sq);
+    if (mag_sq > module.event.peak_mag_sq) module.event.peak_mag_sq = mag_sq;
+    if (severity > module.event.severity) module.event.severity = severity;
+    module.event.post[module.n_post++] = s;
+
+    if (module.n_post == IMPACT_POST_SAMPLES) {
+        if (module.handler) module.handler(&module.event, module.aux_data);
+        // post samples become the history for the next event, then re-arm
+        for (int i = 0; i < IMPACT_PRE_SAMPLES; i++) {
+            module.history[i] = module.event.post[IMPACT_POST_SAMPLES - IMPACT_PRE_SAMPLES + i];
+        }
+        module.head = 0;
+        module.n_post = -1;
+    }
+    return severity;
+}
@@ -0,0 +1,60 @@
+/* File: impact.h
+ * --------------
+ * Crash and hard-impact detection for the MSA311 accelerometer stream.
+ *
+ * The detector compares the squared acceleration magnitude against squared
+ * thresholds, so each sample costs three multiplies, two compares and a
+ * ring buffer store: no sqrt and no float (see the commented-out
+ * simple_sqrtf in bike_demo.c for why that matters).
+ *
+ * A short history of readings is kept at all times. Once a threshold is
+ * crossed the detector records IMPACT_POST_SAMPLES more readings and then
+ * hands the registered handler an event with the readings before and after
+ * the trigger.
+ */
+
+#ifndef IMPACT_H
+#define IMPACT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Buffer sizes (pre must be a power of two, it is indexed with a mask) */
+#define IMPACT_PRE_SAMPLES   16
+#define IMPACT_POST_SAMPLES  16
+
+/* Default thresholds in mg (1 g at rest, bumps on rough roads reach ~2.5 g) */
+#define IMPACT_HARD_MG       3000
+#define IMPACT_CRASH_MG      6000
+
+typedef enum {
+    IMPACT_NONE = 0,
+    IMPACT_HARD,
+    IMPACT_CRASH
+} impact_severity_t;
+
+typedef struct {
+    int16_t x_mg, y_mg, z_mg;
+} impact_sample_t;
+
+typedef struct {
+    impact_severity_t severity;     // worst severity seen in the event window
+    unsigned long ticks;            // timer ticks of the triggering sample
+    uint32_t peak_mag_sq;           // largest squared magnitude (mg^2) in the window
+    impact_sample_t pre[IMPACT_PRE_SAMPLES];   // oldest first, last entry is the trigger
+    impact_sample_t post[IMPACT_POST_SAMPLES]; // readings after the trigger
+} impact_event_t;
+
+typedef void (*impact_handler_t)(const impact_event_t *evt, void *aux_data);
+
+/* Squared magnitude in mg^2; fits in 32 bits for the full +/-16 g range */
+static inline uint32_t impact_magnitude_sq(int x_mg, int y_mg, int z_mg) {
+    return (uint32_t)(x_mg * x_mg) + (uint32_t)(y_mg * y_mg) + (uint32_t)(z_mg * z_mg);
+}
+
+void impact_init(int hard_mg, int crash_mg);
+void impact_register_handler(impact_handler_t fn, void *aux_data);
+impact_severity_t impact_process_sample(int x_mg, int y_mg, int z_mg, unsigned long ticks);
+bool impact_in_progress(void);
+
+#endif /* IMPACT_H */
@@ -13,6 +13,7 @@
 #include "timer.h"
 #include "assert.h"
 #include "gpio_extra.h"
+#include "interrupts.h"
 #include <stdarg.h>
 
 /*
@@ -99,12 +100,49 @@ _Static_assert(&(PWM_BASE->regs.channel[3].pcr)     == (void *)0x02000D60, "pwm
 _Static_assert(&(PWM_BASE->regs.channel[7].ppr)     == (void *)0x02000DE4, "pwm ppr[7] reg must be at address 0x02000DE4");
 _Static_assert(&(PWM_BASE->regs.channel[5].ppcntr)  == (void *)0x02000DAC, "pwm ppcntr[5] reg must be at address 0x02000DAC");
 
+typedef struct {
+    volatile uint32_t value;        // latest posted PPR value
+    volatile uint32_t posted;       // sequence numbers: latest posted,
+    volatile uint32_t written;      //   latest written to PPR,
+    volatile uint32_t done;         //   latest in effect
+    pwm_commit_fn_t handler;
+    void *aux_data;
+} deferred_t;
+
+typedef struct {
+    volatile bool pending;          // staged, waiting for the channel's period end
+    uint32_t ppr;
+    int prescale;                   // k - 1
+    int mode;
+    int pulse_num;                  // count - 1, pulse mode
+    int clk_src;                    // pair clock
+    int clk_div;
+} slow_t;
+
+typedef struct {
+    uint32_t members;               // channel bit mask, 0 if not configured
+    pwm_channel_id_t lead;          // longest period: commits land at its period end
+    uint32_t staged;                // members with a staged value
+    volatile bool writing;          // commit copying values, don't apply yet
+    volatile uint32_t posted;       // commit sequence numbers: latest committed,
+    volatile uint32_t done;         //   latest on the outputs
+} group_t;
+
 static struct {
     volatile pwm_t * const pwm;
     struct {
         int k;
         int n_entire;
+        int div_log2;   // pair clock divider, only changed for capture
+        long src_hz;    // pair clock source rate (HOSC or APB0)
     } clk_settings[8]; // store per channel
+    deferred_t deferred[8];     // pwm_post_*() state per channel
+    uint32_t deferring;         // channels set up by pwm_defer_enable()
+    uint32_t staged_ppr[8];     // group values waiting for pwm_group_commit()
+    group_t group[4];
+    volatile uint32_t held;     // channels whose posts wait for a group commit
+    slow_t slow[8];             // slow output changes waiting for a period end
+    bool irq_registered;
     bool initialized;
 } module = {
     .pwm = PWM_BASE,
@@ -115,8 +153,13 @@ enum { SRC_HOSC = 0, SRC_APB0 = 1 };
 enum { MODE_CYCLE_CONTINUOUS = 0, MODE_PULSE = 1 };
 enum { ACTIVE_LOW = 0, ACTIVE_HIGH = 1 };
 enum { PERIOD_READY = 0, PERIOD_BUSY = 1 };
+enum { CCR_CAPINV = 1 << 0, CCR_CFLF = 1 << 1, CCR_CRLF = 1 << 2 }; // capture control bits
 
 static const int HOSC_FREQ = 24000000;
+static const long PLL_PERI_1X_FREQ = 600000000; // as configured at boot
+
+#define CCU_APB0_CLK_REG ((volatile uint32_t *)0x02001520)
+enum { APB0_SRC_HOSC = 0, APB0_SRC_PLL_PERI_1X = 3 };
 
 #define ceil(x, y) ((x) + (y) - 1)/(y)
 
@@ -186,29 +229,110 @@ static bool set_pin_fn_to_pwm(pwm_channel_id_t ch, gpio_id_t pin) {
  * Change code to write to ppr in single operation that sets
  * both fields in one go seems to behave perfectly, no glitch
 */
-static void set_period(pwm_channel_id_t ch, int n_active, int n_entire) {
+static uint32_t ppr_value(int n_active, int n_entire) {
     assert(n_entire >= 1 && n_entire < 65535);
     assert(n_active >= 0 && n_active <= n_entire);
-    module.pwm->regs.channel[ch].ppr = ((n_entire - 1) << 16) | n_active;   // see note above
+    return ((n_entire - 1) << 16) | n_active;
+}
+
+static void set_period(pwm_channel_id_t ch, int n_active, int n_entire) {
+    module.pwm->regs.channel[ch].ppr = ppr_value(n_active, n_entire);   // see note above
     while (module.pwm->regs.channel[ch].pcr.period_ready == PERIOD_BUSY)
              ; // wait for settings to take effect
 }
 
-static void config_clock_settings(pwm_channel_id_t ch, int desired_freq) {
-    int Q = HOSC_FREQ/desired_freq;
-    // Q = k * n_entire
-    // choose factors s.t. n_entire < 65536, minimize k (also k must be <= 256)
-    int k = ceil(Q, 65535);
-    int n_entire = HOSC_FREQ/(k*desired_freq);
-    assert(n_entire >= 0 && n_entire <= 65535);
-    assert(k >= 0 && k <= 256);
-    module.clk_settings[ch].k = k;
-    module.clk_settings[ch].n_entire = n_entire;
+/*
+ * APB0 rate from its clock register: source / N / M. Only the HOSC and
+ * PLL_PERI(1X) sources are worked out; for anything else (32K, PSI) this
+ * returns 0 and the channel stays on HOSC.
+ */
+static long apb0_freq(void) {
+    uint32_t reg = *CCU_APB0_CLK_REG;
+    long m = (reg & 0x1f) + 1;
+    long n = 1 << ((reg >> 8) & 0x3);
+    switch ((reg >> 24) & 0x3) {
+        case APB0_SRC_HOSC:        return HOSC_FREQ / (n * m);
+        case APB0_SRC_PLL_PERI_1X: return PLL_PERI_1X_FREQ / (n * m);
+        default:                   return 0;
+    }
+}
+
+/*
+ * Prescaler k and count n_entire for a period of num/den seconds:
+ * Q = src * num/den = k * n_entire, smallest k that keeps n_entire < 65535,
+ * so the period spans as many counts as possible. False if no k <= 256 fits.
+ */
+static bool choose_divisor(long src_hz, unsigned long num, unsigned long den, int *k, int *n_entire) {
+    uint64_t Q = (uint64_t)src_hz * num / den;
+    if (Q < 1) return false;
+    uint64_t kk = ceil(Q, 65534);
+    if (kk > 256) return false;
+    *k = kk;
+    *n_entire = Q / kk;
+    return true;
+}
+
+/*
+ * Picks the clock source (HOSC or APB0) and prescaler that give the most
+ * counts per period, i.e. the finest duty/pulse resolution. Periods longer
+ * than the prescaler alone can reach (below ~1.4 Hz from HOSC, e.g. LED
+ * blinking) also divide the pair clock by 2^div. The source and divider
+ * are shared by a channel pair, so if the partner is in use the pair's
+ * current ones are kept. The period is num/den seconds.
+ *
+ * Only works them out: returns the pair clock source, for the caller to
+ * write with clk_settings[ch].div_log2 to the pair's PCCR.
+ */
+static int choose_clock_settings(pwm_channel_id_t ch, unsigned long num, unsigned long den) {
+    assert(num > 0 && den > 0);
+    int pair = ch / 2, partner = ch ^ 1;
+    bool partner_busy = (module.pwm->regs.per & (1 << partner)) || (module.pwm->regs.cer & (1 << partner));
+    int current_src = module.pwm->regs.pccr[pair].clk_src;
+    int current_div = module.pwm->regs.pccr[pair].clk_div;
+    const struct { int src; long hz; } sources[] = {
+        { SRC_HOSC, HOSC_FREQ },
+        { SRC_APB0, apb0_freq() },
+    };
+
+    int best = -1, best_div = 0, best_k = 0, best_n = 0;
+    for (int i = 0; i < sizeof(sources)/sizeof(*sources); i++) {
+        if (sources[i].hz == 0) continue;
+        if (partner_busy && sources[i].src != current_src) continue;
+        for (int div = 0; div <= 8; div++) {  // least division that fits keeps the most counts
+            int k, n_entire;
+            if (partner_busy && div != current_div) continue;
+            if (!choose_divisor(sources[i].hz >> div, num, den, &k, &n_entire)) continue;
+            if (n_entire > best_n) {
+                best = i;
+                best_div = div;
+                best_k = k;
+                best_n = n_entire;
+            }
+            break;
+        }
+    }
+    assert(best >= 0); // period out of range for the pair's clock
+    module.clk_settings[ch].k = best_k;
+    module.clk_settings[ch].n_entire = best_n;
+    module.clk_settings[ch].div_log2 = best_div;
+    module.clk_settings[ch].src_hz = sources[best].hz >> best_div;  // rate the prescaler sees
+    if (!partner_busy) {
+        module.clk_settings[partner].div_log2 = best_div;
+        module.clk_settings[partner].src_hz = sources[best].hz >> best_div;
+    }
+    return sources[best].src;
+}
+
+static void config_clock_settings(pwm_channel_id_t ch, unsigned long num, unsigned long den) {
+    int src = choose_clock_settings(ch, num, den);
+    module.pwm->regs.pccr[ch / 2].clk_src = src;
+    module.pwm->regs.pccr[ch / 2].clk_div = module.clk_settings[ch].div_log2;
 }
 
 void pwm_config_channel(pwm_channel_id_t ch, gpio_id_t pin, int freq, bool invert) {
     if (!module.initialized) error("pwm_init() has not been called!\n");
-    config_clock_settings(ch, freq);
+    assert(freq > 0);
+    config_clock_settings(ch, 1, freq);
     if (!set_pin_fn_to_pwm(ch, pin)) {
         printf("Did not find pwm functionality for pin %s and PWM%d\n", gpio_get_name_for_id(pin), ch);
         assert(0);
@@ -233,6 +357,36 @@ void pwm_set_duty(pwm_channel_id_t ch, int percentile) {
     set_period(ch, scaled_active, n_steps);
 }
 
+/*
+ * Active time in ns, rounded to the nearest count of the channel clock
+ * (k / src_hz apart). Must not exceed the period.
+ */
+static int pulse_ns_to_counts(pwm_channel_id_t ch, unsigned long ns) {
+    bool pwm_ch_enabled = (module.pwm->regs.per & (1 << ch)); // confirm ch is config/enabled
+    assert(pwm_ch_enabled);
+    uint64_t k = module.clk_settings[ch].k;
+    // counts = ns * src_hz / (k * 1e9), rounded
+    uint64_t n_active = ((uint64_t)ns * module.clk_settings[ch].src_hz + k * 500000000) / (k * 1000000000);
+    assert(n_active <= module.clk_settings[ch].n_entire);
+    return n_active;
+}
+
+void pwm_set_pulse_us(pwm_channel_id_t ch, unsigned int us) {
+    set_period(ch, pulse_ns_to_counts(ch, (unsigned long)us * 1000), module.clk_settings[ch].n_entire);
+}
+
+static int fraction_to_counts(pwm_channel_id_t ch, int num, int den) {
+    bool pwm_ch_enabled = (module.pwm->regs.per & (1 << ch)); // confirm ch is config/enabled
+    assert(pwm_ch_enabled);
+    assert(den > 0 && num >= 0 && num <= den);
+    return ((long)num * module.clk_settings[ch].n_entire + den / 2) / den;
+}
+
+/* Duty cycle num/den of the period, e.g. 65/1000 for 6.5%, rounded to the nearest count */
+void pwm_set_duty_fraction(pwm_channel_id_t ch, int num, int den) {
+    set_period(ch, fraction_to_counts(ch, num, den), module.clk_settings[ch].n_entire);
+}
+
 void pwm_set_freq(pwm_channel_id_t ch, int freq) {
     bool pwm_ch_enabled = (module.pwm->regs.per & (1 << ch));  // confirm ch is config/enabled
     assert(pwm_ch_enabled);
@@ -240,7 +394,7 @@ void pwm_set_freq(pwm_channel_id_t ch, int freq) {
     if (freq == 0) {
         pwm_set_duty(ch, 0); // turn off
     } else {
-        config_clock_settings(ch, freq);
+        config_clock_settings(ch, 1, freq);
         int k = module.clk_settings[ch].k;
         module.pwm->regs.channel[ch].pcr.prescale = k - 1; // apply prescaler
         int n_entire = module.clk_settings[ch].n_entire;
@@ -250,6 +404,376 @@ void pwm_set_freq(pwm_channel_id_t ch, int freq) {
     }
 }
 
+/*
+ * Deferred commit
+ * ---------------
+ * pwm_post_*() store the new PPR value and return at once. If the channel
+ * has no update in flight the value is written straight away and the
+ * hardware takes it at the end of the current period; otherwise the period
+ * interrupt (PIER/PISR) writes it at the next period end. Posting again
+ * before then just replaces the value, so rapid updates collapse to the
+ * latest one and none of them waits.
+ *
+ * Each post returns a sequence number; once the period interrupt finds the
+ * hardware has taken that value (or a later one), pwm_post_done() is true
+ * and the channel's handler, if any, is called.
+ *
+ * The interrupt handler can't nest with the posters (interrupts don't
+ * nest, and a poster interrupted by it rereads the latest value before
+ * writing), so the worst a race can do is write the latest value twice.
+ */
+static void apply_group(int group);
+static void write_slow(pwm_channel_id_t ch);
+static void apply_slow(pwm_channel_id_t ch);
+
+static void handle_period_irq(void *aux_data) {
+    uint32_t status = module.pwm->regs.pisr & module.pwm->regs.pier;
+    module.pwm->regs.pisr = status;    // write 1 to clear
+    for (int ch = 0; ch < 8; ch++) {
+        if (!(status & (1 << ch))) continue;
+        // a held channel's slow change goes out with its group
+        if (module.slow[ch].pending && !(module.held & (1 << ch))) apply_slow(ch);
+        bool leading = false;
+        for (int g = 0; g < 4; g++) {
+            group_t *grp = &module.group[g];
+            if (!grp->members || grp->lead != ch || grp->done == grp->posted) continue;
+            if (grp->writing) {
+                leading = true;     // next period end, once the commit has its values in
+            } else {
+                apply_group(g);
+            }
+        }
+        if (!(module.deferring & (1 << ch))) {
+            if (!leading) module.pwm->regs.pier &= ~(1 << ch);    // only on for a change
+            continue;
+        }
+        if (module.pwm->regs.channel[ch].pcr.period_ready == PERIOD_BUSY) continue;
+        deferred_t *d = &module.deferred[ch];
+        uint32_t written = d->written;
+        if (d->done != written) {
+            d->done = written;      // the period that just ended took it
+            if (d->handler) d->handler(ch, written, d->aux_data);
+        }
+        uint32_t posted = d->posted;
+        if (posted != written && !(module.held & (1 << ch))) {
+            module.pwm->regs.channel[ch].ppr = d->value;
+            d->written = posted;
+        }
+    }
+}
+
+static void register_irq(void) {
+    if (!module.irq_registered) {
+        interrupts_register_source(INTERRUPT_SOURCE_PWM, handle_period_irq, NULL);
+        interrupts_enable_source(INTERRUPT_SOURCE_PWM);
+        module.irq_registered = true;
+    }
+}
+
+/* Period interrupt on for ch, from its next period end (not one already past) */
+static void want_period_irq(pwm_channel_id_t ch) {
+    if (module.pwm->regs.pier & (1 << ch)) return;
+    module.pwm->regs.pisr = (1 << ch);
+    module.pwm->regs.pier |= (1 << ch);
+}
+
+/* Requires interrupts_init(); handler (may be NULL) runs in interrupt context */
+void pwm_defer_enable(pwm_channel_id_t ch, pwm_commit_fn_t handler, void *aux_data) {
+    bool pwm_ch_enabled = (module.pwm->regs.per & (1 << ch)); // confirm ch is config/enabled
+    assert(pwm_ch_enabled);
+    register_irq();
+    module.deferred[ch].handler = handler;
+    module.deferred[ch].aux_data = aux_data;
+    module.deferred[ch].written = module.deferred[ch].posted;
+    module.deferred[ch].done = module.deferred[ch].posted;
+    module.deferring |= (1 << ch);
+    want_period_irq(ch);
+}
+
+static uint32_t post(pwm_channel_id_t ch, int n_active) {
+    assert(module.deferring & (1 << ch)); // pwm_defer_enable() first
+    deferred_t *d = &module.deferred[ch];
+    d->value = ppr_value(n_active, module.clk_settings[ch].n_entire);
+    uint32_t seq = d->posted + 1;
+    d->posted = seq;
+    if (d->written == d->done && !(module.held & (1 << ch))
+        && module.pwm->regs.channel[ch].pcr.period_ready == PERIOD_READY) {
+        module.pwm->regs.channel[ch].ppr = d->value;   // nothing in flight: takes effect this period
+        d->written = d->posted;
+    }
+    return seq;
+}
+
+/* Returns at once with a sequence number for pwm_post_done() */
+uint32_t pwm_post_pulse_us(pwm_channel_id_t ch, unsigned int us) {
+    return post(ch, pulse_ns_to_counts(ch, (unsigned long)us * 1000));
+}
+
+uint32_t pwm_post_duty_fraction(pwm_channel_id_t ch, int num, int den) {
+    return post(ch, fraction_to_counts(ch, num, den));
+}
+
+/* True once the posted value, or one posted after it, is on the output */
+bool pwm_post_done(pwm_channel_id_t ch, uint32_t seq) {
+    return (int32_t)(module.deferred[ch].done - seq) >= 0;
+}
+
+/*
+ * Channel groups
+ * --------------
+ * A group is up to eight channels whose new values go out together. Values
+ * are staged per channel, then pwm_group_commit() hands them all to the
+ * deferred-post path at once and returns. At the next period end of the
+ * group's lead (the member with the longest period, so none of the others
+ * is cut short when they share its period ends) the period interrupt stops
+ * the members, writes each staged PPR, and restarts them with one group
+ * start. The new values all start on the same edge and the outputs stay
+ * phase aligned; nobody waits on any channel's period_ready.
+ *
+ * A member's own posts made while a commit is waiting go out with it (the
+ * latest value wins, as for pwm_post_*()), and so does a slow output
+ * change staged before the commit; one staged after it replaces the
+ * member's committed value. Members with a committed value run continuous
+ * from then on, so a channel left in pulse mode by a blink pattern is
+ * steady again. A commit is called done, and the members' commit handlers run,
+ * as soon as the group restarts, since the new values are on the pins from
+ * that edge.
+ *
+ * Commits may come from interrupt context. From the main loop, a period
+ * interrupt that lands while the values are being copied leaves them for
+ * the next period end, so a half-copied commit is never applied.
+ */
+static void apply_group(int group) {
+    group_t *grp = &module.group[group];
+    uint32_t members = grp->members, pulsing = 0;
+    module.pwm->regs.per &= ~members;          // hold the members while their PPRs change
+    module.pwm->regs.pgr[group].start = 0;
+    for (int ch = 0; ch < 8; ch++) {
+        if (!(members & (1 << ch))) continue;
+        if (module.slow[ch].pending) {
+            write_slow(ch);
+            if (module.slow[ch].mode == MODE_PULSE) pulsing |= (1 << ch);
+        }
+        deferred_t *d = &module.deferred[ch];
+        if (d->posted == d->written) continue;
+        module.pwm->regs.channel[ch].ppr = d->value;
+        module.pwm->regs.channel[ch].pcr.mode = MODE_CYCLE_CONTINUOUS;
+        module.pwm->regs.channel[ch].pcr.pulse_start = 0;
+        pulsing &= ~(1 << ch);
+        d->written = d->posted;
+    }
+    module.held &= ~members;
+    module.pwm->regs.per |= members;
+    module.pwm->regs.pgr[group].start = 1;     // all counters restart together, on the new values
+    for (int ch = 0; ch < 8; ch++) {
+        if (pulsing & (1 << ch)) module.pwm->regs.channel[ch].pcr.pulse_start = 1;
+    }
+    grp->done = grp->posted;
+    for (int ch = 0; ch < 8; ch++) {
+        if (!(members & (1 << ch))) continue;
+        deferred_t *d = &module.deferred[ch];
+        if (d->done == d->written) continue;
+        d->done = d->written;
+        if (d->handler) d->handler(ch, d->written, d->aux_data);
+    }
+}
+
+/* Period of ch compared to other's: <0, 0 or >0 */
+static int compare_period(pwm_channel_id_t ch, pwm_channel_id_t other) {
+    // k * n_entire / src_hz, cross-multiplied
+    uint64_t a = (uint64_t)module.clk_settings[ch].k * module.clk_settings[ch].n_entire * module.clk_settings[other].src_hz;
+    uint64_t b = (uint64_t)module.clk_settings[other].k * module.clk_settings[other].n_entire * module.clk_settings[ch].src_hz;
+    return (a > b) - (a < b);
+}
+
+/*
+ * Puts channels (bit mask, e.g. 1 << PWM3 | 1 << PWM4) in group 0-3 and
+ * restarts them together. Requires interrupts_init(); call once the
+ * members' frequencies are set, since the lead is picked from them.
+ */
+void pwm_group_config(int group, uint32_t channels) {
+    assert(group >= 0 && group < 4);
+    assert(channels != 0 && channels <= 0xff);
+    assert((module.pwm->regs.per & channels) == channels); // members must be configured outputs
+    group_t *grp = &module.group[group];
+    int lead = -1;
+    for (int ch = 0; ch < 8; ch++) {
+        if (!(channels & (1 << ch))) continue;
+        for (int g = 0; g < 4; g++) {
+            assert(g == group || (module.group[g].members & (1 << ch)) == 0); // one group per channel
+        }
+        if (lead < 0 || compare_period(ch, lead) > 0) lead = ch;
+        deferred_t *d = &module.deferred[ch];
+        if (!(module.deferring & (1 << ch))) {
+            d->written = d->posted;     // nothing of its own in flight
+            d->done = d->posted;
+        }
+    }
+    register_irq();
+    grp->members = channels;
+    grp->lead = lead;
+    grp->staged = 0;
+    grp->done = grp->posted;
+
+    module.pwm->regs.pgr[group].enable = 0;
+    module.pwm->regs.pgr[group].start = 0;
+    module.pwm->regs.pgr[group].select = channels;
+    for (int ch = 0; ch < 8; ch++) {
+        if (channels & (1 << ch)) module.pwm->regs.channel[ch].pcntr.counter_start = 0;
+    }
+    module.pwm->regs.pgr[group].enable = 1;
+    module.pwm->regs.pgr[group].start = 1;  // all counters restart together
+}
+
+static int group_of(pwm_channel_id_t ch) {
+    for (int g = 0; g < 4; g++) {
+        if (module.group[g].members & (1 << ch)) return g;
+    }
+    return -1;
+}
+
+static void stage(pwm_channel_id_t ch, int n_active) {
+    int g = group_of(ch);
+    assert(g >= 0); // pwm_group_config() first
+    module.staged_ppr[ch] = ppr_value(n_active, module.clk_settings[ch].n_entire);
+    module.group[g].staged |= (1 << ch);
+}
+
+/* Stage a new setting; nothing changes on the pin until pwm_group_commit() */
+void pwm_group_stage_pulse_us(pwm_channel_id_t ch, unsigned int us) {
+    stage(ch, pulse_ns_to_counts(ch, (unsigned long)us * 1000));
+}
+
+void pwm_group_stage_duty_fraction(pwm_channel_id_t ch, int num, int den) {
+    stage(ch, fraction_to_counts(ch, num, den));
+}
+
+/* Returns at once with a sequence number for pwm_group_done(); see above */
+uint32_t pwm_group_commit(int group) {
+    assert(group >= 0 && group < 4);
+    group_t *grp = &module.group[group];
+    assert(grp->members); // pwm_group_config() first
+    grp->writing = true;
+    module.held |= grp->members;
+    for (int ch = 0; ch < 8; ch++) {
+        if (!(grp->staged & (1 << ch))) continue;
+        deferred_t *d = &module.deferred[ch];
+        d->value = module.staged_ppr[ch];
+        d->posted = d->posted + 1;
+    }
+    grp->staged = 0;
+    uint32_t seq = grp->posted + 1;
+    grp->posted = seq;
+    grp->writing = false;
+    want_period_irq(grp->lead);
+    return seq;
+}
+
+/* True once the commit, or a later one, is on the outputs */
+bool pwm_group_done(int group, uint32_t seq) {
+    return (int32_t)(module.group[group].done - seq) >= 0;
+}
+
+/*
+ * Slow outputs
+ * ------------
+ * For periods too long to give in whole Hz (LED blinking at 1-2 Hz), set
+ * the period and on time directly. Once set, the hardware keeps the
+ * pattern going with no CPU involvement.
+ *
+ * Pulse mode outputs `count` periods and then stops with the output
+ * inactive; the hardware clears pcr.pulse_start when it is done.
+ *
+ * These setters don't wait for the period in progress to end: on a
+ * blinking LED that could be most of a second. The whole change (pair
+ * clock, prescaler, mode, pulse count and PPR) is staged for the channel
+ * and the period interrupt applies it at the period end, stopping the
+ * channel for the writes and restarting it on the new settings, so the
+ * old period runs out at its own rate and the new one starts whole. A
+ * second change before then replaces the first; the caller never waits.
+ * A channel that has finished its pulses has no period end coming, so a
+ * change to it is applied at once.
+ *
+ * So a change shows on the pin after the rest of the period in progress:
+ * up to 1 ms from a steady 1 kHz output, up to a whole blink period from
+ * a pattern (see blink.h).
+ */
+static void write_slow(pwm_channel_id_t ch) {
+    slow_t *c = &module.slow[ch];
+    module.pwm->regs.pccr[ch / 2].clk_src = c->clk_src;
+    module.pwm->regs.pccr[ch / 2].clk_div = c->clk_div;
+    module.pwm->regs.channel[ch].pcr.prescale = c->prescale;
+    module.pwm->regs.channel[ch].pcr.mode = c->mode;
+    module.pwm->regs.channel[ch].pcr.pulse_num = c->pulse_num;
+    module.pwm->regs.channel[ch].pcr.pulse_start = 0;
+    module.pwm->regs.channel[ch].ppr = c->ppr;     // stopped, so taken as it restarts
+    c->pending = false;
+}
+
+static void apply_slow(pwm_channel_id_t ch) {
+    module.pwm->regs.per &= ~(1 << ch);
+    write_slow(ch);
+    module.pwm->regs.per |= (1 << ch);
+    if (module.slow[ch].mode == MODE_PULSE) module.pwm->regs.channel[ch].pcr.pulse_start = 1;
+}
+
+/* Stages the change (see above); clk_settings already describe it for the next setter */
+static void post_slow(pwm_channel_id_t ch, unsigned long num, unsigned long den, int mode, int count) {
+    bool pwm_ch_enabled = (module.pwm->regs.per & (1 << ch)); // confirm ch is config/enabled
+    assert(pwm_ch_enabled);
+    slow_t *c = &module.slow[ch];
+    c->pending = false;     // a change not yet applied is replaced, not half-overwritten
+    c->clk_src = choose_clock_settings(ch, num, den);
+    c->clk_div = module.clk_settings[ch].div_log2;
+    c->prescale = module.clk_settings[ch].k - 1;
+    c->mode = mode;
+    c->pulse_num = count - 1;
+    if (module.held & (1 << ch)) {
+        module.deferred[ch].written = module.deferred[ch].posted;  // a group value not yet out loses to this
+    }
+}
+
+static void commit_slow(pwm_channel_id_t ch, int n_active) {
+    slow_t *c = &module.slow[ch];
+    c->ppr = ppr_value(n_active, module.clk_settings[ch].n_entire);
+    bool stopped = module.pwm->regs.channel[ch].pcr.mode == MODE_PULSE
+                   && module.pwm->regs.channel[ch].pcr.pulse_start == 0;
+    register_irq();
+    c->pending = true;
+    if (stopped && !(module.held & (1 << ch))) {
+        apply_slow(ch);     // no period end to wait for
+    } else {
+        want_period_irq(ch);
+    }
+}
+
+void pwm_set_period_us(pwm_channel_id_t ch, unsigned long period_us, unsigned long active_us) {
+    assert(active_us <= period_us);
+    post_slow(ch, period_us, 1000000, MODE_CYCLE_CONTINUOUS, 1);
+    commit_slow(ch, pulse_ns_to_counts(ch, active_us * 1000));
+}
+
+/* Back to a steady duty at freq Hz from a slow output, without waiting (see above) */
+void pwm_set_steady(pwm_channel_id_t ch, int freq, int percentile) {
+    assert(freq > 0);
+    assert(percentile >= 0 && percentile <= 100);
+    post_slow(ch, 1, freq, MODE_CYCLE_CONTINUOUS, 1);
+    commit_slow(ch, (percentile * module.clk_settings[ch].n_entire) / 100);
+}
+
+/* Starts `count` periods and returns at once; see pwm_pulses_done() */
+void pwm_start_pulses(pwm_channel_id_t ch, unsigned long period_us, unsigned long active_us, int count) {
+    assert(count >= 1 && count <= 65536);
+    assert(active_us <= period_us);
+    post_slow(ch, period_us, 1000000, MODE_PULSE, count);
+    commit_slow(ch, pulse_ns_to_counts(ch, active_us * 1000));
+}
+
+/* False while a change is still waiting for its period end */
+bool pwm_pulses_done(pwm_channel_id_t ch) {
+    return !module.slow[ch].pending && module.pwm->regs.channel[ch].pcr.pulse_start == 0;
+}
+
 void pwm_disable(pwm_channel_id_t ch, gpio_id_t pin) {
     // Ensure the channel is valid
     assert(ch >= PWM0 && ch <= PWM7);
@@ -270,3 +794,84 @@ void pwm_enable(pwm_channel_id_t ch) {
     // Set the enable bit in the 'per' register for the specified channel
     module.pwm->regs.per |= (1 << ch);
 }
+
+
+/*
+ * Capture mode
+ * ------------
+ * In capture mode the channel's 16-bit counter runs from the prescaled
+ * clock and restarts on every captured edge. On a rising edge the count
+ * (i.e. the low time just ended) is latched to CRLR and CRLF set; on a
+ * falling edge the high time is latched to CFLR and CFLF set. Both flags
+ * are write-1-to-clear. Latching is done by hardware at the edge, so
+ * the readings don't depend on when (or whether) software gets around to
+ * reading them, as long as it reads before the next edge of same kind.
+ *
+ * The counter is only 16 bits, so the clock is divided down just enough
+ * that max_period_us fits in 65535 counts; a level lasting longer than that
+ * wraps and reads short. Counts are reported scaled back to HOSC ticks
+ * (24 per usec), the same units as timer_get_ticks().
+ *
+ * If the clock needs more than the 8-bit prescaler, the divider shared with
+ * the paired channel is used too, so the partner can't be an output then.
+ */
+static void config_capture_clock(pwm_channel_id_t ch, int max_period_us) {
+    long hosc_counts = (long)max_period_us * (HOSC_FREQ / 1000000);
+    int total = ceil(hosc_counts, 65535);   // overall divisor needed
+    int div_log2 = 0;
+    while (ceil(total, 1 << div_log2) > 256) div_log2++;
+    assert(div_log2 <= 8);
+    int k = ceil(total, 1 << div_log2);
+    if (k < 1) k = 1;
+
+    int partner = ch ^ 1;
+    bool partner_enabled = (module.pwm->regs.per & (1 << partner)) || (module.pwm->regs.cer & (1 << partner));
+    assert(div_log2 == module.clk_settings[partner].div_log2 || !partner_enabled);
+
+    // capture counts are reported in HOSC ticks, so the pair must run from HOSC
+    assert(module.pwm->regs.pccr[ch / 2].clk_src == SRC_HOSC || !partner_enabled);
+
+    module.clk_settings[ch].k = k;
+    module.clk_settings[ch].n_entire = 0;
+    module.clk_settings[ch].div_log2 = div_log2;
+    module.clk_settings[ch].src_hz = HOSC_FREQ >> div_log2;  // rate the prescaler sees
+    module.pwm->regs.pccr[ch / 2].clk_src = SRC_HOSC;
+    module.pwm->regs.pccr[ch / 2].clk_div = div_log2;
+    module.pwm->regs.channel[ch].pcr.prescale = k - 1;
+}
+
+void pwm_capture_config(pwm_channel_id_t ch, gpio_id_t pin, int max_period_us) {
+    if (!module.initialized) error("pwm_init() has not been called!\n");
+    assert(max_period_us > 0);
+    if (!set_pin_fn_to_pwm(ch, pin)) {
+        printf("Did not find pwm functionality for pin %s and PWM%d\n", gpio_get_name_for_id(pin), ch);
+        assert(0);
+    }
+    module.pwm->regs.per &= ~(1 << ch);            // not an output
+    module.pwm->regs.pcgr.clk_gating |= (1 << ch); // open clock gate for channel
+    module.pwm->regs.pcgr.clk_bypass &= ~(1 << ch);
+    config_capture_clock(ch, max_period_us);
+    module.pwm->regs.channel[ch].ccr = CCR_CFLF | CCR_CRLF; // clear stale latches, no invert
+    module.pwm->regs.cer |= (1 << ch);             // enable capture
+}
+
+static unsigned long counts_to_hosc(pwm_channel_id_t ch, uint32_t counts) {
+    return ((unsigned long)counts * module.clk_settings[ch].k) << module.clk_settings[ch].div_log2;
+}
+
+/*
+ * Full period (low + high) since the last call, in HOSC ticks. Returns false
+ * until both a rising and a falling edge have been latched.
+ */
+bool pwm_capture_read_period(pwm_channel_id_t ch, unsigned long *period_ticks) {
+    bool capture_enabled = (module.pwm->regs.cer & (1 << ch));
+    assert(capture_enabled);
+    uint32_t flags = module.pwm->regs.channel[ch].ccr;
+    if ((flags & (CCR_CRLF | CCR_CFLF)) != (CCR_CRLF | CCR_CFLF)) return false;
+
+    uint32_t low = module.pwm->regs.channel[ch].crlr & 0xffff;
+    uint32_t high = module.pwm->regs.channel[ch].cflr & 0xffff;
+    module.pwm->regs.channel[ch].ccr = (flags & CCR_CAPINV) | CCR_CRLF | CCR_CFLF; // clear latches
+    *period_ticks = counts_to_hosc(ch, low + high);
+    return true;
+}
@@ -28,9 +28,41 @@ void pwm_config_channel(pwm_channel_id_t ch, gpio_id_t pin, int freq, bool inver
 void pwm_set_duty(pwm_channel_id_t ch, int percentile); // percentile range 0-100%
 void pwm_set_freq(pwm_channel_id_t ch, int freq);       // set freq, duty cycle 50% (square wave)
 
+// full counter resolution: pulse width in time, or duty as a fraction num/den
+void pwm_set_pulse_us(pwm_channel_id_t ch, unsigned int us);
+void pwm_set_duty_fraction(pwm_channel_id_t ch, int num, int den);
+
+// deferred commit: post a value and return at once, the period interrupt
+// writes it if the channel is busy; latest post wins (needs interrupts_init())
+typedef void (*pwm_commit_fn_t)(pwm_channel_id_t ch, uint32_t seq, void *aux_data);
+void pwm_defer_enable(pwm_channel_id_t ch, pwm_commit_fn_t handler, void *aux_data);
+uint32_t pwm_post_pulse_us(pwm_channel_id_t ch, unsigned int us);
+uint32_t pwm_post_duty_fraction(pwm_channel_id_t ch, int num, int den);
+bool pwm_post_done(pwm_channel_id_t ch, uint32_t seq);
+
+// groups (0-3): stage values for several channels, commit them to go out on one
+// group start at the lead channel's next period end; never waits (needs interrupts_init())
+void pwm_group_config(int group, uint32_t channels);   // channels: bit mask, e.g. 1 << PWM4
+void pwm_group_stage_pulse_us(pwm_channel_id_t ch, unsigned int us);
+void pwm_group_stage_duty_fraction(pwm_channel_id_t ch, int num, int den);
+uint32_t pwm_group_commit(int group);
+bool pwm_group_done(int group, uint32_t seq);
+
+// slow outputs (blinking): period and on time, continuous or `count` periods then stop;
+// these return at once, the period interrupt applies the change when the period in
+// progress ends (needs interrupts_init())
+void pwm_set_period_us(pwm_channel_id_t ch, unsigned long period_us, unsigned long active_us);
+void pwm_start_pulses(pwm_channel_id_t ch, unsigned long period_us, unsigned long active_us, int count);
+bool pwm_pulses_done(pwm_channel_id_t ch);
+void pwm_set_steady(pwm_channel_id_t ch, int freq, int percentile);   // steady duty again after blinking
+
 
 void pwm_disable(pwm_channel_id_t ch, gpio_id_t pin);
 
 void pwm_enable(pwm_channel_id_t ch);
 
+// capture mode: hardware-latched edge timing on an input pin, results in HOSC ticks (24/usec)
+void pwm_capture_config(pwm_channel_id_t ch, gpio_id_t pin, int max_period_us);
+bool pwm_capture_read_period(pwm_channel_id_t ch, unsigned long *period_ticks);
+
 #endif
\ No newline at end of file
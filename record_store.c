@@ -0,0 +1,59 @@
+/* File: record_store.c
+ * --------------------
+ * RAM-backed record slots (see record_store.h).
+ */
+
+#include "record_store.h"
+#include "assert.h"
+#include <stdint.h>
+#include "strings.h"
+
+#define TOTAL_SLOTS 3
+
+// slots of each area, in order (trip: TRIP_RECORD_SLOTS)
+static const struct {
+    int first;
+    int count;
+} areas[RECORD_STORE_AREA_COUNT] = {
+    [RECORD_STORE_TRIP]      = { 0, 2 },
+    [RECORD_STORE_SERVO_CAL] = { 2, 1 },
+};
+
+static struct {
+    uint8_t data[TOTAL_SLOTS][RECORD_STORE_SLOT_BYTES];
+    size_t len[TOTAL_SLOTS];    // bytes last written, 0 if never
+} module;
+
+/* Every slot reads as missing until written */
+void record_store_init(void) {
+    for (int i = 0; i < TOTAL_SLOTS; i++) {
+        module.len[i] = 0;
+    }
+}
+
+int record_store_slots(record_store_area_t area) {
+    assert(area < RECORD_STORE_AREA_COUNT);
+    return areas[area].count;
+}
+
+static int slot_index(record_store_area_t area, int slot, size_t len) {
+    assert(area < RECORD_STORE_AREA_COUNT);
+    assert(slot >= 0 && slot < areas[area].count);
+    assert(len > 0 && len <= RECORD_STORE_SLOT_BYTES);
+    return areas[area].first + slot;
+}
+
+/* False if the slot was never written or holds a record of another size */
+bool record_store_read(record_store_area_t area, int slot, void *buf, size_t len) {
+    int i = slot_index(area, slot, len);
+    if (module.len[i] != len) return false;
+    memcpy(buf, module.data[i], len);
+    return true;
+}
+
+bool record_store_write(record_store_area_t area, int slot, const void *buf, size_t len) {
+    int i = slot_index(area, slot, len);
+    memcpy(module.data[i], buf, len);
+    module.len[i] = len;
+    return true;
+}
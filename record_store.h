@@ -0,0 +1,36 @@
+/* File: record_store.h
+ * --------------------
+ * Storage for the small checksummed records other modules keep: trip
+ * totals (trip.h) and the servo calibration (servo_cal.h).
+ *
+ * The store is split into areas, one per client, each holding a fixed
+ * number of slots of up to RECORD_STORE_SLOT_BYTES. A slot that has never
+ * been written reads as missing; whether its contents are any good is up
+ * to the client's own checksum.
+ *
+ * The board support has no flash or SD driver, so the slots live in RAM:
+ * records are kept while the program runs, and a restart loses them. The
+ * clients only see read/write of a slot, so a non-volatile backend can
+ * replace this one without touching them.
+ */
+
+#ifndef RECORD_STORE_H
+#define RECORD_STORE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define RECORD_STORE_SLOT_BYTES  64
+
+typedef enum {
+    RECORD_STORE_TRIP = 0,      // TRIP_RECORD_SLOTS slots
+    RECORD_STORE_SERVO_CAL,     // one slot
+    RECORD_STORE_AREA_COUNT
+} record_store_area_t;
+
+void record_store_init(void);
+int record_store_slots(record_store_area_t area);
+bool record_store_read(record_store_area_t area, int slot, void *buf, size_t len);
+bool record_store_write(record_store_area_t area, int slot, const void *buf, size_t len);
+
+#endif /* RECORD_STORE_H */
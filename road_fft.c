@@ -0,0 +1,227 @@
+/* File: road_fft.c
+ * ----------------
+ * Fixed-point real FFT and road roughness features (see road_fft.h).
+ *
+ * The N-point real FFT is computed as an N/2-point complex FFT over the
+ * even/odd samples packed as re/im, followed by the usual split step:
+ *
+ *     Fe[k] = (Z[k] + conj(Z[M-k])) / 2
+ *     Fo[k] = (Z[k] - conj(Z[M-k])) / 2j
+ *     X[k]  = Fe[k] + W_N^k * Fo[k]          k = 0..M, M = N/2
+ *
+ * Each radix-2 stage halves its output so values never grow past the
+ * input range; overall scale is 1/M, which puts |X[k]| in the same units
+ * as the input amplitude.
+ */
+
+#include "road_fft.h"
+#include "timer.h"
+
+#define M (ROAD_FFT_N / 2)
+#define LOG2M (ROAD_FFT_LOG2N - 1)
+_Static_assert(ROAD_FFT_LOG2N >= 6 && ROAD_FFT_LOG2N <= 8, "ROAD_FFT_N must be 64..256");
+
+// sin(2*pi*i/256) in Q15 for i = 0..64 (quarter wave, enough for N <= 256)
+static const int16_t sin_q15[65] = {
+        0,   804,  1608,  2411,  3212,  4011,  4808,  5602,
+     6393,  7180,  7962,  8740,  9512, 10279, 11039, 11793,
+    12540, 13279, 14010, 14733, 15447, 16151, 16846, 17531,
+    18205, 18868, 19520, 20160, 20788, 21403, 22006, 22595,
+    23170, 23732, 24279, 24812, 25330, 25833, 26320, 26791,
+    27246, 27684, 28106, 28511, 28899, 29269, 29622, 29957,
+    30274, 30572, 30853, 31114, 31357, 31581, 31786, 31972,
+    32138, 32286, 32413, 32522, 32610, 32679, 32729, 32758,
+    32767,
+};
+
+#define TABLE_STRIDE (256 / ROAD_FFT_N)
+#define Q15_HALF (1 << 14)     // rounds twiddle products instead of truncating
+
+// cos/sin of 2*pi*k/N for k = 0..N/2
+static inline int32_t twiddle_cos(int k) {
+    int j = k * TABLE_STRIDE;
+    return (j <= 64) ? sin_q15[64 - j] : -sin_q15[j - 64];
+}
+
+static inline int32_t twiddle_sin(int k) {
+    int j = k * TABLE_STRIDE;
+    return (j <= 64) ? sin_q15[j] : sin_q15[128 - j];
+}
+
+static struct {
+    int16_t block[ROAD_FFT_N];
+    int n;                          // samples in current block
+    int32_t sum;                    // running sum for DC removal
+    uint64_t power[ROAD_FFT_BINS];
+    road_features_t features;
+    unsigned int max_ticks;         // longest block so far
+    unsigned int overruns;          // blocks over ROAD_FFT_BUDGET_TICKS
+} module;
+
+void road_fft_init(void) {
+    module.n = 0;
+    module.sum = 0;
+    module.max_ticks = 0;
+    module.overruns = 0;
+    module.features = (road_features_t){ .surface = ROAD_SMOOTH };
+}
+
+static unsigned int bit_reverse(unsigned int i) {
+    unsigned int r = 0;
+    for (int b = 0; b < LOG2M; b++) {
+        r = (r << 1) | (i & 1);
+        i >>= 1;
+    }
+    return r;
+}
+
+/* In-place M-point complex FFT, scaled by 1/M */
+static void complex_fft(int32_t *re, int32_t *im) {
+    for (unsigned int i = 0; i < M; i++) {
+        unsigned int r = bit_reverse(i);
+        if (r > i) {
+            int32_t t = re[i]; re[i] = re[r]; re[r] = t;
+            t = im[i]; im[i] = im[r]; im[r] = t;
+        }
+    }
+    for (int half = 1, step = M / 2; half < M; half <<= 1, step >>= 1) {
+        for (int j = 0; j < half; j++) {
+            // W_M^(j*step) = W_N^(2*j*step)
+            int64_t wr = twiddle_cos(2 * j * step);
+            int64_t wi = -twiddle_sin(2 * j * step);
+            for (int a = j; a < M; a += 2 * half) {
+                int b = a + half;
+                int32_t tr = (int32_t)((wr * re[b] - wi * im[b] + Q15_HALF) >> 15);
+                int32_t ti = (int32_t)((wr * im[b] + wi * re[b] + Q15_HALF) >> 15);
+                re[b] = (re[a] - tr) >> 1;
+                im[b] = (im[a] - ti) >> 1;
+                re[a] = (re[a] + tr) >> 1;
+                im[a] = (im[a] + ti) >> 1;
+            }
+        }
+    }
+}
+
+/* Power spectrum |X[k]|^2 for k = 0..N/2 of N real samples */
+void road_fft_real(const int16_t *in, uint64_t *power) {
+    int32_t re[M], im[M];
+    for (int i = 0; i < M; i++) {
+        re[i] = in[2 * i];
+        im[i] = in[2 * i + 1];
+    }
+    complex_fft(re, im);
+
+    for (int k = 0; k <= M; k++) {
+        int a = k % M, b = (M - k) % M;
+        int32_t fe_r = (re[a] + re[b]) >> 1;      // Fe = (Z[k] + conj(Z[M-k]))/2
+        int32_t fe_i = (im[a] - im[b]) >> 1;
+        int32_t fo_r = (im[a] + im[b]) >> 1;      // Fo = (Z[k] - conj(Z[M-k]))/2j
+        int32_t fo_i = (re[b] - re[a]) >> 1;
+        int64_t wr = twiddle_cos(k), wi = -twiddle_sin(k);
+        int64_t xr = fe_r + ((wr * fo_r - wi * fo_i + Q15_HALF) >> 15);
+        int64_t xi = fe_i + ((wr * fo_i + wi * fo_r + Q15_HALF) >> 15);
+        power[k] = (uint64_t)(xr * xr + xi * xi);
+    }
+}
+
+/* Band edges in bins: [1, M/8), [M/8, M/4), [M/4, M/2), [M/2, M] */
+static int band_for_bin(int k) {
+    if (k < M / 8) return 0;
+    if (k < M / 4) return 1;
+    if (k < M / 2) return 2;
+    return 3;
+}
+
+static road_surface_t classify(uint64_t vibration) {
+    if (vibration >= (uint64_t)ROAD_ROUGH_MG * ROAD_ROUGH_MG) return ROAD_ROUGH;
+    if (vibration >= (uint64_t)ROAD_NORMAL_MG * ROAD_NORMAL_MG) return ROAD_NORMAL;
+    return ROAD_SMOOTH;
+}
+
+static void analyze_block(void) {
+    unsigned long start = timer_get_ticks();
+
+    // remove DC (gravity, mounting tilt) using the running sum
+    int32_t mean = module.sum / ROAD_FFT_N;
+    for (int i = 0; i < ROAD_FFT_N; i++) {
+        module.block[i] -= mean;
+    }
+    road_fft_real(module.block, module.power);
+
+    uint64_t band[ROAD_FFT_BANDS] = {0};
+    for (int k = 1; k <= M; k++) {
+        band[band_for_bin(k)] += module.power[k];
+    }
+
+    // exponential smoothing across blocks, first block seeds the average
+    road_features_t *f = &module.features;
+    f->vibration = 0;
+    for (int b = 0; b < ROAD_FFT_BANDS; b++) {
+        if (f->blocks == 0) {
+            f->band[b] = band[b];
+        } else {
+            f->band[b] = f->band[b] - (f->band[b] >> 2) + (band[b] >> 2);
+        }
+        if (b > 0) f->vibration += f->band[b];
+    }
+    f->surface = classify(f->vibration);
+    f->blocks++;
+
+    unsigned int elapsed = timer_get_ticks() - start;
+    if (elapsed > module.max_ticks) module.max_ticks = elapsed;
+    if (elapsed > ROAD_FFT_BUDGET_TICKS) module.overruns++;
+}
+
+/* Returns true when this sample completed a block and features were updated */
+bool road_fft_push(int sample_mg) {
+    if (sample_mg > INT16_MAX) sample_mg = INT16_MAX;
+    if (sample_mg < INT16_MIN) sample_mg = INT16_MIN;
+    module.block[module.n++] = sample_mg;
+    module.sum += sample_mg;
+    if (module.n < ROAD_FFT_N) return false;
+
+    analyze_block();
+    module.n = 0;
+    module.sum = 0;
+    return true;
+}
+
+/* Drops the partial block, e.g. samples taken at a rate no longer in effect */
+void road_fft_restart_block(void) {
+    module.n = 0;
+    module.sum = 0;
+}
+
+const road_features_t *road_fft_features(void) {
+    return &module.features;
+}
+
+road_surface_t road_fft_surface(void) {
+    return module.features.surface;
+}
+
+/* Loosen a detection threshold on rough roads so vibration isn't read as a turn */
+int road_scale_threshold(int base) {
+    switch (module.features.surface) {
+        case ROAD_ROUGH:  return base + base / 2;
+        case ROAD_NORMAL: return base + base / 4;
+        default:          return base;
+    }
+}
+
+/* Brake aggressiveness in permille; less grip on rough roads */
+int road_brake_scale_permille(void) {
+    switch (module.features.surface) {
+        case ROAD_ROUGH:  return 700;
+        case ROAD_NORMAL: return 850;
+        default:          return 1000;
+    }
+}
+
+unsigned int road_fft_max_us(void) {
+    return module.max_ticks / TICKS_PER_USEC;
+}
+
+unsigned int road_fft_overruns(void) {
+    return module.overruns;
+}
@@ -0,0 +1,82 @@
+/* File: road_fft.h
+ * ----------------
+ * Road-surface vibration analysis using a fixed-point real FFT.
+ *
+ * Accelerometer readings (one axis, in mg) are pushed one at a time into a
+ * block of ROAD_FFT_N samples. When a block fills, a Q15 real FFT runs over
+ * it and the bin powers are folded into ROAD_FFT_BANDS band energies as they
+ * are produced, then smoothed into the running features. Nothing is
+ * re-scanned, so each block costs one FFT plus O(N) bookkeeping.
+ *
+ * Bins are only meaningful if a block is sampled at one rate. When the
+ * sample rate changes, call road_fft_restart_block() before pushing the
+ * first sample at the new rate.
+ *
+ * Band energies are in mg^2: a sinusoidal vibration of amplitude A mg adds
+ * roughly A^2 to the band containing its frequency.
+ *
+ * Everything is integer math (rv64im has no FPU); 64-bit products are a
+ * single mul on the target.
+ */
+
+#ifndef ROAD_FFT_H
+#define ROAD_FFT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Block length 2^LOG2N, 6..8 gives 64..256 points */
+#define ROAD_FFT_LOG2N   7
+#define ROAD_FFT_N       (1 << ROAD_FFT_LOG2N)
+#define ROAD_FFT_BINS    (ROAD_FFT_N/2 + 1)
+#define ROAD_FFT_BANDS   4
+
+/*
+ * Cycle budget per block on the 1 GHz C906 (rv64im, no FPU), worked out
+ * for the largest block, N = 256 (M = 128):
+ *
+ *   complex FFT   7 stages x 64 butterflies, ~30 instructions each  13.5k
+ *   bit reversal  128 indices x 7-step loop                          4.5k
+ *   real split    129 bins, ~40 instructions each                    5k
+ *   DC removal, band sums and smoothing                              2k
+ *
+ * About 25k instructions. The C906 issues one per cycle at best and a
+ * multiply takes several, and the main loop has usually evicted the block
+ * and the twiddle table by the time a block completes, so the budget
+ * allows 2.4 cycles per instruction: 60k cycles, 60 us (1440 timer
+ * ticks). Each block is timed against it on the target;
+ * road_fft_max_us() and road_fft_overruns() show how close it comes.
+ * tests/bench_road_fft.c times blocks on the host against the same figure.
+ */
+#define ROAD_FFT_BUDGET_CYCLES  60000
+#define ROAD_FFT_BUDGET_TICKS   (ROAD_FFT_BUDGET_CYCLES / 1000 * 24)
+
+/* Roughness levels, from the vibration energy above the lowest band */
+typedef enum {
+    ROAD_SMOOTH = 0,
+    ROAD_NORMAL,
+    ROAD_ROUGH
+} road_surface_t;
+
+#define ROAD_NORMAL_MG   150   // vibration amplitude above which road is "normal"
+#define ROAD_ROUGH_MG    500   // ... and "rough"
+
+typedef struct {
+    uint64_t band[ROAD_FFT_BANDS];  // smoothed band energies, mg^2
+    uint64_t vibration;             // sum of bands above band 0
+    road_surface_t surface;
+    unsigned int blocks;            // number of blocks analyzed so far
+} road_features_t;
+
+void road_fft_init(void);
+bool road_fft_push(int sample_mg);
+void road_fft_restart_block(void);
+void road_fft_real(const int16_t *in, uint64_t *power);
+const road_features_t *road_fft_features(void);
+road_surface_t road_fft_surface(void);
+int road_scale_threshold(int base);
+int road_brake_scale_permille(void);
+unsigned int road_fft_max_us(void);
+unsigned int road_fft_overruns(void);
+
+#endif /* ROAD_FFT_H */
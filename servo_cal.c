@@ -0,0 +1,211 @@
+/* File: servo_cal.c
+ * -----------------
+ * Servo angle to pulse width from calibration points (see servo_cal.h).
+ */
+
+#include "servo_cal.h"
+#include "checksum.h"
+#include "printf.h"
+#include "uart.h"
+#include "assert.h"
+#include <stddef.h>
+
+#define CAL_MAGIC     0x4c414353    // "SCAL"
+#define CAL_VERSION   1
+#define ANGLE_ENTRIES (SERVO_CAL_MAX_DEG - SERVO_CAL_MIN_DEG + 1)
+#define JOG_COARSE_US 10
+
+typedef struct {
+    int16_t deg;
+    uint16_t us;
+} cal_point_t;
+
+// persistent record: 44 bytes
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t checksum;      // Fletcher-16 over the record with this field 0
+    uint32_t npoints;
+    cal_point_t points[SERVO_CAL_MAX_POINTS];   // by increasing angle
+} cal_record_t;
+
+static struct {
+    const servo_cal_storage_t *storage;
+    cal_point_t points[SERVO_CAL_MAX_POINTS];
+    int npoints;
+    uint16_t angle_us[ANGLE_ENTRIES];   // per degree from SERVO_CAL_MIN_DEG
+} module;
+
+static uint16_t record_checksum(const cal_record_t *rec) {
+    return checksum_record(rec, sizeof(*rec), offsetof(cal_record_t, checksum));
+}
+
+static bool points_valid(const cal_point_t *points, int npoints) {
+    if (npoints < 2 || npoints > SERVO_CAL_MAX_POINTS) return false;
+    for (int i = 0; i < npoints; i++) {
+        if (points[i].deg < SERVO_CAL_MIN_DEG || points[i].deg > SERVO_CAL_MAX_DEG) return false;
+        if (points[i].us < SERVO_CAL_MIN_US || points[i].us > SERVO_CAL_MAX_US) return false;
+        if (i > 0 && points[i].deg <= points[i - 1].deg) return false;
+    }
+    return true;
+}
+
+static bool record_valid(const cal_record_t *rec) {
+    return rec->magic == CAL_MAGIC && rec->version == CAL_VERSION &&
+           rec->checksum == record_checksum(rec) && points_valid(rec->points, rec->npoints);
+}
+
+/* num/den rounded to nearest, den > 0 */
+static int div_round(int num, int den) {
+    return (num >= 0) ? (num + den / 2) / den : -((-num + den / 2) / den);
+}
+
+/* Pulse at an angle in thousandths of a degree, clamped to the calibrated range */
+static unsigned int interpolate(int angle_mdeg) {
+    const cal_point_t *p = module.points;
+    int n = module.npoints;
+    if (angle_mdeg <= p[0].deg * 1000) return p[0].us;
+    if (angle_mdeg >= p[n - 1].deg * 1000) return p[n - 1].us;
+    int i = 1;
+    while (angle_mdeg > p[i].deg * 1000) i++;
+    int span_mdeg = (p[i].deg - p[i - 1].deg) * 1000;
+    int into_mdeg = angle_mdeg - p[i - 1].deg * 1000;
+    // (pulse span) * (angle into segment) stays well inside int: 2000 * 180000
+    return p[i - 1].us + div_round(((int)p[i].us - p[i - 1].us) * into_mdeg, span_mdeg);
+}
+
+/* The only place with per-entry work; runs when the points change */
+static void rebuild_tables(void) {
+    for (int i = 0; i < ANGLE_ENTRIES; i++) {
+        module.angle_us[i] = interpolate((SERVO_CAL_MIN_DEG + i) * 1000);
+    }
+}
+
+/* Back to the hand-tuned endpoints */
+void servo_cal_reset(void) {
+    module.points[0] = (cal_point_t){ .deg = -90, .us = 1300 };
+    module.points[1] = (cal_point_t){ .deg = 85, .us = 1900 };
+    module.npoints = 2;
+    rebuild_tables();
+}
+
+void servo_cal_init(void) {
+    module.storage = NULL;
+    servo_cal_reset();
+}
+
+/* Loads the stored calibration if there is a valid one, else keeps the current points */
+void servo_cal_set_storage(const servo_cal_storage_t *storage) {
+    module.storage = storage;
+    if (!storage) return;
+    cal_record_t rec;
+    if (!storage->read(&rec, sizeof(rec)) || !record_valid(&rec)) return;
+    for (int i = 0; i < rec.npoints; i++) {
+        module.points[i] = rec.points[i];
+    }
+    module.npoints = rec.npoints;
+    rebuild_tables();
+}
+
+/* Adds or replaces the point at angle_deg; false if out of range or the table is full */
+bool servo_cal_set_point(int angle_deg, unsigned int pulse_us) {
+    if (angle_deg < SERVO_CAL_MIN_DEG || angle_deg > SERVO_CAL_MAX_DEG) return false;
+    if (pulse_us < SERVO_CAL_MIN_US || pulse_us > SERVO_CAL_MAX_US) return false;
+    int i = 0;
+    while (i < module.npoints && module.points[i].deg < angle_deg) i++;
+    if (i == module.npoints || module.points[i].deg != angle_deg) {
+        if (module.npoints == SERVO_CAL_MAX_POINTS) return false;
+        for (int j = module.npoints; j > i; j--) {
+            module.points[j] = module.points[j - 1];
+        }
+        module.npoints++;
+    }
+    module.points[i] = (cal_point_t){ .deg = angle_deg, .us = pulse_us };
+    rebuild_tables();
+    return true;
+}
+
+/* False if there is no storage or the write failed */
+bool servo_cal_save(void) {
+    if (!module.storage) return false;
+    cal_record_t rec = { .magic = CAL_MAGIC, .version = CAL_VERSION, .npoints = module.npoints };
+    for (int i = 0; i < module.npoints; i++) {
+        rec.points[i] = module.points[i];
+    }
+    rec.checksum = record_checksum(&rec);
+    return module.storage->write(&rec, sizeof(rec));
+}
+
+/* Lets the user nudge the pulse until the arm is where it should be; false on quit */
+static bool jog(pwm_channel_id_t ch, const char *what, int angle_deg, unsigned int *pulse_us) {
+    unsigned int us = *pulse_us;
+    printf("Jog the arm to %s (%d deg): +/- %d us, >/< 1 us, Enter to accept, q to quit\n",
+           what, angle_deg, JOG_COARSE_US);
+    while (true) {
+        pwm_post_pulse_us(ch, us);
+        printf("\r%d us   ", us);
+        int step = 0;
+        switch (uart_getchar()) {
+            case '+': step = JOG_COARSE_US; break;
+            case '-': step = -JOG_COARSE_US; break;
+            case '>': step = 1; break;
+            case '<': step = -1; break;
+            case '\r':
+            case '\n':
+                printf("\n");
+                *pulse_us = us;
+                return true;
+            case 'q':
+                printf("\n");
+                return false;
+        }
+        int next = (int)us + step;
+        if (next >= SERVO_CAL_MIN_US && next <= SERVO_CAL_MAX_US) us = next;
+    }
+}
+
+/*
+ * Interactive endpoint capture over the UART: the servo on `ch` (configured
+ * at 50 Hz, with pwm_defer_enable() as brake_actuator_init() leaves it, and
+ * interrupts on) is jogged by posting each nudge like any other brake
+ * pulse, to full brake and to fully released. The two points are replaced
+ * and the result is saved if there is storage. The arm is left released.
+ * False if the user quit; nothing is changed then.
+ */
+bool servo_cal_guided(pwm_channel_id_t ch) {
+    unsigned int engage_us = servo_cal_angle_us(SERVO_CAL_ENGAGE_DEG);
+    unsigned int release_us = servo_cal_angle_us(SERVO_CAL_RELEASE_DEG);
+    bool done = jog(ch, "full brake, pads firmly on the rim", SERVO_CAL_ENGAGE_DEG, &engage_us) &&
+                jog(ch, "fully released, pads clear", SERVO_CAL_RELEASE_DEG, &release_us);
+    if (done) {
+        servo_cal_set_point(SERVO_CAL_ENGAGE_DEG, engage_us);
+        servo_cal_set_point(SERVO_CAL_RELEASE_DEG, release_us);
+        if (module.storage && !servo_cal_save()) printf("Calibration not saved!\n");
+    }
+    pwm_post_pulse_us(ch, servo_cal_angle_us(SERVO_CAL_RELEASE_DEG));
+    return done;
+}
+
+void servo_cal_print(void) {
+    printf("Servo calibration:");
+    for (int i = 0; i < module.npoints; i++) {
+        printf(" %d deg = %d us%s", module.points[i].deg, module.points[i].us, i + 1 < module.npoints ? "," : "\n");
+    }
+}
+
+/* Hot path: one table read */
+unsigned int servo_cal_angle_us(int angle_deg) {
+    if (angle_deg < SERVO_CAL_MIN_DEG) angle_deg = SERVO_CAL_MIN_DEG;
+    if (angle_deg > SERVO_CAL_MAX_DEG) angle_deg = SERVO_CAL_MAX_DEG;
+    return module.angle_us[angle_deg - SERVO_CAL_MIN_DEG];
+}
+
+/* Hot path for motion profiles: thousandths of a degree, a table read and one linear step */
+unsigned int servo_cal_angle_mdeg_us(int angle_mdeg) {
+    if (angle_mdeg <= SERVO_CAL_MIN_DEG * 1000) return module.angle_us[0];
+    if (angle_mdeg >= SERVO_CAL_MAX_DEG * 1000) return module.angle_us[ANGLE_ENTRIES - 1];
+    int offset = angle_mdeg - SERVO_CAL_MIN_DEG * 1000;   // > 0
+    int i = offset / 1000;
+    int delta = (int)module.angle_us[i + 1] - module.angle_us[i];
+    return module.angle_us[i] + div_round(delta * (offset % 1000), 1000);
+}
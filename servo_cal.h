@@ -0,0 +1,58 @@
+/* File: servo_cal.h
+ * -----------------
+ * Servo calibration: angle to pulse width through a measured table.
+ *
+ * The theoretical pulse for an angle doesn't match where the arm ends up:
+ * cable drag on the brake loses some of the travel, more near the ends
+ * (the README's -90/+85 workaround). Instead of hand-tuned constants, the
+ * calibration keeps a few measured (angle, pulse) points and interpolates
+ * between them. From those a dense table, pulse per whole degree from -90
+ * to +90, is built whenever the points change, so servo_cal_angle_us() is
+ * a table lookup on the hot path (servo_cal_angle_mdeg_us() adds one linear
+ * step), with no floats. Brake force goes through brake_actuator.h, which
+ * maps it to an arm angle first.
+ *
+ * servo_cal_guided() walks through jogging the arm to each end over the
+ * UART and records them; bike_demo.c runs it when the button is held at
+ * boot. The points are kept in storage the caller supplies (same scheme
+ * as trip.h; bike_demo.c uses record_store.h) as a small checksummed
+ * record; without storage, or with no valid record, the hand-tuned defaults
+ * (1300 us at -90, 1900 us at +85) are used.
+ */
+
+#ifndef SERVO_CAL_H
+#define SERVO_CAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "pwm.h"
+
+#define SERVO_CAL_MIN_DEG       (-90)
+#define SERVO_CAL_MAX_DEG       90
+#define SERVO_CAL_MAX_POINTS    8
+#define SERVO_CAL_MIN_US        500     // servo limits, anything outside is rejected
+#define SERVO_CAL_MAX_US        2500
+
+/* Brake geometry: arm angles for full brake and fully released */
+#define SERVO_CAL_ENGAGE_DEG    (-90)
+#define SERVO_CAL_RELEASE_DEG   85
+
+typedef struct {
+    // read or write the calibration record; false on failure
+    bool (*read)(void *buf, size_t len);
+    bool (*write)(const void *buf, size_t len);
+} servo_cal_storage_t;
+
+void servo_cal_init(void);
+void servo_cal_set_storage(const servo_cal_storage_t *storage);
+bool servo_cal_set_point(int angle_deg, unsigned int pulse_us);
+void servo_cal_reset(void);
+bool servo_cal_save(void);
+bool servo_cal_guided(pwm_channel_id_t ch);
+void servo_cal_print(void);
+
+unsigned int servo_cal_angle_us(int angle_deg);
+unsigned int servo_cal_angle_mdeg_us(int angle_mdeg);
+
+#endif /* SERVO_CAL_H */
@@ -0,0 +1,131 @@
+/* File: servo_motion.c
+ * --------------------
+ * Trapezoidal servo motion stepped by the control timer (see servo_motion.h).
+ */
+
+#include "servo_motion.h"
+#include "control_timer.h"
+#include "servo_cal.h"
+#include "assert.h"
+#include <stdint.h>
+#include <stddef.h>
+
+static struct {
+    pwm_channel_id_t ch;
+    volatile int target;        // mdeg
+    int pos;                    // mdeg, setpoint sent to the servo
+    int vel;                    // mdeg per step
+    int max_vel;                // mdeg per step
+    int accel;                  // mdeg per step per step
+    volatile bool reached;
+    bool initialized;
+} module;
+
+static uint32_t isqrt(uint64_t x) {
+    uint64_t root = 0, bit = 1ULL << 62;
+    while (bit > x) bit >>= 2;
+    while (bit) {
+        if (x >= root + bit) {
+            x -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+static int clamp(int x, int lo, int hi) {
+    return x < lo ? lo : (x > hi ? hi : x);
+}
+
+/*
+ * One servo frame. The fastest speed that can still stop on the target is
+ * sqrt(2 * accel * distance); the velocity moves toward that (capped at
+ * max_vel) by at most accel per step, which gives the trapezoid: ramp up,
+ * cruise, ramp down. The half-step of accel taken off the stopping speed
+ * makes up for position moving by whole steps, so the arm doesn't
+ * overshoot.
+ */
+static void motion_step(void *aux_data) {
+    if (module.reached) return;
+    int target = module.target;
+    int dist = target - module.pos;
+    int a = module.accel;
+
+    if (dist >= -a && dist <= a && module.vel >= -a && module.vel <= a) {
+        module.pos = target;
+        module.vel = 0;
+        module.reached = true;
+    } else {
+        int stop_vel = (int)isqrt(2ULL * a * (uint32_t)(dist < 0 ? -dist : dist)) - a / 2;
+        stop_vel = clamp(stop_vel, 0, module.max_vel);
+        int want = dist < 0 ? -stop_vel : stop_vel;
+        module.vel += clamp(want - module.vel, -a, a);
+        module.pos += module.vel;
+    }
+    pwm_post_pulse_us(module.ch, servo_cal_angle_mdeg_us(module.pos));
+}
+
+/*
+ * Requires the channel configured at the servo rate, interrupts_init() and
+ * servo_cal_init(). Puts the arm at start_mdeg at once and starts the
+ * control timer if nobody has yet.
+ */
+void servo_motion_init(pwm_channel_id_t ch, int start_mdeg) {
+    assert(!module.initialized);
+    module.ch = ch;
+    module.target = start_mdeg;
+    module.pos = start_mdeg;
+    module.vel = 0;
+    module.reached = true;
+    servo_motion_set_limits(SERVO_MOTION_MAX_DPS, SERVO_MOTION_ACCEL_DPS2);
+    pwm_set_pulse_us(ch, servo_cal_angle_mdeg_us(start_mdeg));
+    pwm_defer_enable(ch, NULL, NULL);
+
+    control_timer_init();
+    bool added = control_timer_add(motion_step, NULL, CONTROL_MS_TO_TICKS(1000 / SERVO_MOTION_RATE_HZ));
+    assert(added);
+    module.initialized = true;
+}
+
+/* Takes effect on the next step, including mid-move */
+void servo_motion_set_limits(int max_dps, int accel_dps2) {
+    assert(max_dps > 0 && accel_dps2 > 0);
+    int rate = SERVO_MOTION_RATE_HZ;
+    module.max_vel = max_dps * 1000 / rate;
+    module.accel = accel_dps2 * 1000 / (rate * rate);
+    if (module.accel < 1) module.accel = 1;
+}
+
+/* Returns at once; replaces any move in progress */
+void servo_motion_move_to(int target_mdeg) {
+    module.target = target_mdeg;
+    module.reached = false;     // published after the target
+}
+
+/*
+ * The arm was sent to angle_mdeg without the profile: stop there, with
+ * nothing further to post. Call from interrupt context so no step runs
+ * half way through.
+ */
+void servo_motion_set_position(int angle_mdeg) {
+    module.pos = angle_mdeg;
+    module.vel = 0;
+    module.target = angle_mdeg;
+    module.reached = true;
+}
+
+/* True once the setpoint has arrived and stopped on the latest target */
+bool servo_motion_reached(void) {
+    return module.reached;
+}
+
+int servo_motion_position_mdeg(void) {
+    return module.pos;
+}
+
+int servo_motion_target_mdeg(void) {
+    return module.target;
+}
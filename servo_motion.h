@@ -0,0 +1,42 @@
+/* File: servo_motion.h
+ * --------------------
+ * Trapezoidal motion profiles for the servo arm.
+ *
+ * Stepping the servo straight to a far target yanks the arm against the
+ * cable, which is what locked it at the top and flipped its direction
+ * (see README). Instead, a control timer task (see control_timer.h) moves
+ * a setpoint toward the target once per servo frame (SERVO_MOTION_RATE_HZ,
+ * the 50 Hz PWM rate), accelerating up to the velocity limit and braking
+ * in time to stop on the target. Each setpoint goes out as a calibrated
+ * pulse width (servo_cal.h) posted to the PWM without waiting.
+ *
+ * servo_motion_move_to() returns at once. A new target replaces the old
+ * one mid-move: the profile carries on from the current position and
+ * velocity, slowing first if it has to turn around.
+ *
+ * servo_motion_set_position() is for a path that writes the PWM itself
+ * (see emergency_brake.h): the profile picks up from there, at rest.
+ *
+ * Angles are thousandths of a degree, velocity in degrees per second and
+ * acceleration in degrees per second squared.
+ */
+
+#ifndef SERVO_MOTION_H
+#define SERVO_MOTION_H
+
+#include <stdbool.h>
+#include "pwm.h"
+
+#define SERVO_MOTION_RATE_HZ    50      // one step per servo frame
+#define SERVO_MOTION_MAX_DPS    600     // default limits: about the servo's
+#define SERVO_MOTION_ACCEL_DPS2 4000    // loaded speed, full speed in 150 ms
+
+void servo_motion_init(pwm_channel_id_t ch, int start_mdeg);
+void servo_motion_set_limits(int max_dps, int accel_dps2);
+void servo_motion_move_to(int target_mdeg);
+void servo_motion_set_position(int angle_mdeg);
+bool servo_motion_reached(void);
+int servo_motion_position_mdeg(void);
+int servo_motion_target_mdeg(void);
+
+#endif /* SERVO_MOTION_H */
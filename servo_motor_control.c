@@ -15,9 +15,14 @@ void configure_pwm(void) {
     pwm_config_channel(PWM_CHANNEL, SERVO_PIN, PWM_FREQUENCY, false);
 }
 
-/* Moves the servo to a specific position */
+/* Moves the servo to a specific position, duty in percent (hundredths kept) */
 void move_servo(float duty_cycle) {
-    pwm_set_duty(PWM_CHANNEL, duty_cycle);
+    pwm_set_duty_fraction(PWM_CHANNEL, (int)(duty_cycle * 100 + 0.5f), 10000);
+}
+
+/* Moves the servo to the position for a given pulse width */
+void move_servo_us(unsigned int pulse_us) {
+    pwm_set_pulse_us(PWM_CHANNEL, pulse_us);
 }
 
 /* Adds a delay for the specified time in milliseconds */
@@ -30,10 +35,10 @@ int main(void) {
 
     configure_pwm(); // Configure PWM
 
-    move_servo(DUTY_NEG_90); // Move servo to -90 degrees
+    move_servo_us(PULSE_NEG_90_US); // Move servo to -90 degrees
     delay_ms(10000);         // Hold for 10 seconds
 
-    move_servo(DUTY_POS_85); // Move servo to +85 degrees
+    move_servo_us(PULSE_POS_85_US); // Move servo to +85 degrees
     delay_ms(2000);          // Hold for 2 seconds
 
     return 0;
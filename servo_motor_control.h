@@ -21,10 +21,13 @@
 #define PWM_FREQUENCY    50         // Frequency in Hz (typical for servos)
 #define DUTY_NEG_90      6.5        // Duty cycle for -90 degrees
 #define DUTY_POS_85      9.5        // Duty cycle for +85 degrees
+#define PULSE_NEG_90_US  1300       // Same positions as pulse widths (6.5%, 9.5% of 20 ms)
+#define PULSE_POS_85_US  1900
 
 /* Function Declarations */
 void configure_pwm(void);
 void move_servo(float duty_cycle);
+void move_servo_us(unsigned int pulse_us);
 void delay_ms(unsigned int ms);
 
 #endif /* SERVO_MOTOR_CONTROL_H */
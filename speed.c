@@ -0,0 +1,77 @@
+/* File: speed.c
+ * -------------
+ * Fixed-point, division-free wheel speed (see speed.h).
+ */
+
+#include "speed.h"
+#include "printf.h"
+
+#define PERIOD_WARN   SPEED_PERIOD_FOR_KPH(SPEED_WARN_KPH)
+#define PERIOD_BRAKE  SPEED_PERIOD_FOR_KPH(SPEED_BRAKE_KPH)
+
+// 1/x in Q30 at the midpoint of each of 64 slices of x in [0.5, 1)
+static const uint32_t recip_seed[64] = {
+    2130836488, 2098304633, 2066751180, 2036132644, 2006408080, 1977538899,
+    1949488702, 1922223125, 1895709703, 1869917734, 1844818167, 1820383490,
+    1796587627, 1773405851, 1750814694, 1728791868, 1707316192, 1686367527,
+    1665926709, 1645975491, 1626496491, 1607473140, 1588889636, 1570730897,
+    1552982525, 1535630765, 1518662469, 1502065065, 1485826524, 1469935331,
+    1454380460, 1439151345, 1424237860, 1409630292, 1395319325, 1381296015,
+    1367551776, 1354078359, 1340867839, 1327912594, 1315205296, 1302738895,
+    1290506605, 1278501893, 1266718465, 1255150260, 1243791434, 1232636354,
+    1221679586, 1210915890, 1200340205, 1189947649, 1179733506, 1169693221,
+    1159822392, 1150116765, 1140572228, 1131184802, 1121950641, 1112866020,
+    1103927337, 1095131103, 1086473940, 1077952576,
+};
+
+/*
+ * Approximates NUM / d using only multiplies and shifts.
+ *
+ * d is normalized to x = d << n in [2^31, 2^32), i.e. x/2^32 in [0.5, 1).
+ * A 64-entry table gives 1/x to ~7 bits, two Newton steps
+ * y = y * (2 - x*y) take it to ~28 bits. Then NUM/d = NUM * y * 2^(n-62)
+ * for y in Q30.
+ */
+static uint32_t scaled_reciprocal(uint64_t num, unsigned long d) {
+    if (d == 0) return 0;                   // no revolution measured
+    if (d > UINT32_MAX) return 0;           // > 3 minutes per revolution: stopped
+
+    uint32_t x = d;
+    int n = 0;
+    if (!(x & 0xffff0000u)) { x <<= 16; n += 16; }
+    if (!(x & 0xff000000u)) { x <<= 8;  n += 8;  }
+    if (!(x & 0xf0000000u)) { x <<= 4;  n += 4;  }
+    if (!(x & 0xc0000000u)) { x <<= 2;  n += 2;  }
+    if (!(x & 0x80000000u)) { x <<= 1;  n += 1;  }
+
+    uint64_t y = recip_seed[(x >> 25) - 64];
+    for (int i = 0; i < 2; i++) {
+        uint64_t xy = ((uint64_t)x * y) >> 30;  // x*y in Q32, ~2^32
+        uint64_t t = (2ULL << 32) - xy;         // 2 - x*y in Q32
+        y = (y * t) >> 32;
+    }
+
+    unsigned __int128 q = ((unsigned __int128)num * y) >> (62 - n);
+    return (q > UINT32_MAX) ? UINT32_MAX : (uint32_t)q;
+}
+
+uint32_t speed_kph_q16(unsigned long period_ticks) {
+    return scaled_reciprocal(SPEED_KPH_Q16_NUM, period_ticks);
+}
+
+uint32_t speed_mph_q16(unsigned long period_ticks) {
+    return scaled_reciprocal(SPEED_MPH_Q16_NUM, period_ticks);
+}
+
+/* Shorter period = faster, so bands are just period compares */
+speed_band_t speed_band(unsigned long period_ticks) {
+    if (period_ticks == 0) return SPEED_BAND_SAFE;
+    if (period_ticks <= PERIOD_BRAKE) return SPEED_BAND_BRAKE;
+    if (period_ticks <= PERIOD_WARN) return SPEED_BAND_WARN;
+    return SPEED_BAND_SAFE;
+}
+
+/* Formats a Q16 speed as "12.3" */
+int speed_format(char *buf, size_t bufsize, uint32_t speed_q16) {
+    return snprintf(buf, bufsize, "%d.%d", speed_q16_whole(speed_q16), speed_q16_tenths(speed_q16));
+}
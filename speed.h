@@ -0,0 +1,64 @@
+/* File: speed.h
+ * -------------
+ * Fixed-point wheel speed from the revolution period.
+ *
+ * Works directly in timer ticks (TICKS_PER_USEC = 24). The conversion from
+ * period to speed is folded into a single constant at compile time from
+ * WHEEL_DIAMETER_IN:
+ *
+ *     kph = circumference_um * 86.4 / period_ticks
+ *
+ * and the 1/period is done by a table-seeded Newton reciprocal (multiplies
+ * and shifts only), so there is no division per revolution and a zero
+ * period can't trap. Speeds are Q16.16 (resolution ~0.00002 kph).
+ *
+ * Speed bands only need a compare: the band edges are converted to
+ * periods at compile time and the measured period is compared to those.
+ */
+
+#ifndef SPEED_H
+#define SPEED_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define WHEEL_DIAMETER_IN 26
+
+/* Circumference in micrometers, pi ~ 355/113 (error < 1e-7) */
+#define WHEEL_CIRC_UM      ((uint64_t)WHEEL_DIAMETER_IN * 25400 * 355 / 113)
+
+/* speed_q16 = NUM / period_ticks */
+#define SPEED_KPH_Q16_NUM  (WHEEL_CIRC_UM * 432 * 65536 / 5)        // 86.4 = 432/5
+#define SPEED_MPH_Q16_NUM  (WHEEL_CIRC_UM * 75000 * 65536 / 1397)   // 86.4/1.609344
+
+/* Revolution period (ticks) at a given speed, for compile-time band edges */
+#define SPEED_PERIOD_FOR_KPH(kph) (WHEEL_CIRC_UM * 432 / (5 * (kph)))
+
+/* Display bands, same edges as the original integer-kph code */
+#define SPEED_WARN_KPH     9
+#define SPEED_BRAKE_KPH    13
+
+/* Fastest plausible speed; shorter periods are sensor glitches */
+#define SPEED_MAX_KPH      80
+
+typedef enum {
+    SPEED_BAND_SAFE = 0,    // green
+    SPEED_BAND_WARN,        // yellow, slow down
+    SPEED_BAND_BRAKE        // red, braking
+} speed_band_t;
+
+uint32_t speed_kph_q16(unsigned long period_ticks);
+uint32_t speed_mph_q16(unsigned long period_ticks);
+speed_band_t speed_band(unsigned long period_ticks);
+int speed_format(char *buf, size_t bufsize, uint32_t speed_q16);
+
+/* Whole units and tenths of a Q16 speed, no division */
+static inline unsigned int speed_q16_whole(uint32_t speed_q16) {
+    return speed_q16 >> 16;
+}
+
+static inline unsigned int speed_q16_tenths(uint32_t speed_q16) {
+    return ((speed_q16 & 0xffff) * 10) >> 16;
+}
+
+#endif /* SPEED_H */
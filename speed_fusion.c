@@ -0,0 +1,136 @@
+/* File: speed_fusion.c
+ * --------------------
+ * Fixed-point Kalman fusion of wheel speed and forward acceleration (see speed_fusion.h).
+ */
+
+#include "speed_fusion.h"
+#include "timer.h"
+
+#define Q16(x)            ((int64_t)(x) << 16)
+#define MG_TO_MM_S2_Q16   642689        // 9.80665 mm/s^2 per mg, Q16
+#define DT_Q20_SCALE      187649984ULL  // 2^52 / 24e6: (ticks * this) >> 32 = seconds Q20
+#define INITIAL_SPEED_SD  1000          // mm/s
+#define INITIAL_BIAS_SD   300           // mm/s^2
+#define MAX_COVARIANCE    (1LL << 46)   // Q16, ~ (16 m/s)^2
+
+static struct {
+    int64_t v;                  // speed, mm/s Q16
+    int64_t b;                  // forward axis offset, mm/s^2 Q16
+    int64_t p00, p01, p11;      // covariance, Q16
+    int64_t a_avg;              // smoothed forward acceleration, mm/s^2 Q16
+    bool have_bias;             // first sample seeds b
+    bool have_reading;
+    uint32_t last_passes;
+} module;
+
+void speed_fusion_init(void) {
+    module.v = 0;
+    module.b = 0;
+    module.p00 = Q16(INITIAL_SPEED_SD * INITIAL_SPEED_SD);
+    module.p01 = 0;
+    module.p11 = Q16(INITIAL_BIAS_SD * INITIAL_BIAS_SD);
+    module.a_avg = 0;
+    module.have_bias = false;
+    module.have_reading = false;
+}
+
+/* ticks under about 68 minutes, the product overflows past that */
+static int64_t ticks_to_q20(uint64_t ticks) {
+    return (ticks * DT_Q20_SCALE) >> 32;
+}
+
+/* Q16 * Q20 >> 20 without overflowing the intermediate */
+static int64_t mul_q20(int64_t a, int64_t b_q20) {
+    return ((__int128)a * b_q20) >> 20;
+}
+
+/* Predict: integrate acceleration less offset over the sample interval */
+void speed_fusion_accel(const accel_sample_t *sample) {
+    int axes[3] = { sample->x_mg, sample->y_mg, sample->z_mg };
+    int64_t a = (int64_t)SPEED_FUSION_AXIS_SIGN * axes[SPEED_FUSION_AXIS] * MG_TO_MM_S2_Q16;
+    module.a_avg += (a - module.a_avg) / 8;
+
+    if (!module.have_bias) {
+        module.b = module.a_avg = a;   // assume steady speed at start-up
+        module.have_bias = true;
+        return;
+    }
+
+    // a break in the stream: nothing to integrate over, and the speed is
+    // unknown again until the next wheel reading
+    uint64_t max_gap = (uint64_t)SPEED_FUSION_MAX_GAP_SAMPLES * accel_sched_period_us() * TICKS_PER_USEC;
+    if (sample->dt_ticks > max_gap) {
+        module.p00 = Q16(INITIAL_SPEED_SD * INITIAL_SPEED_SD);
+        module.p01 = 0;
+        return;
+    }
+    if (sample->rate_changed) return;   // dt spans the old and new pace
+
+    int64_t dt = ticks_to_q20(sample->dt_ticks);
+    module.v += mul_q20(a - module.b, dt);
+
+    // P = F P F' + Q with F = [1 -dt; 0 1]
+    int64_t dt_p11 = mul_q20(module.p11, dt);
+    module.p00 += -2 * mul_q20(module.p01, dt) + mul_q20(dt_p11, dt)
+                  + mul_q20(mul_q20(Q16(SPEED_FUSION_ACCEL_NOISE * SPEED_FUSION_ACCEL_NOISE), dt), dt);
+    module.p01 -= dt_p11;
+    module.p11 += mul_q20(Q16(SPEED_FUSION_BIAS_DRIFT * SPEED_FUSION_BIAS_DRIFT), dt);
+
+    // a long run without wheel readings: cap the uncertainty, not the state
+    if (module.p00 > MAX_COVARIANCE) module.p00 = MAX_COVARIANCE;
+    if (module.p11 > MAX_COVARIANCE) module.p11 = MAX_COVARIANCE;
+    if (module.p01 > MAX_COVARIANCE) module.p01 = MAX_COVARIANCE;
+    if (module.p01 < -MAX_COVARIANCE) module.p01 = -MAX_COVARIANCE;
+}
+
+/* Correct: one scalar measurement of v with variance r (both Q16) */
+static void correct(int64_t z, int64_t r) {
+    int64_t s = module.p00 + r;
+    int64_t k0 = (module.p00 << 16) / s;    // gains, Q16; P < 2^46 keeps this in 64 bits
+    int64_t k1 = (module.p01 << 16) / s;
+    int64_t y = z - module.v;
+
+    module.v += ((__int128)k0 * y) >> 16;
+    module.b += ((__int128)k1 * y) >> 16;
+
+    int64_t p00 = module.p00, p01 = module.p01;
+    module.p00 = p00 - (((__int128)k0 * p00) >> 16);
+    module.p01 = p01 - (((__int128)k0 * p01) >> 16);
+    module.p11 = module.p11 - (((__int128)k1 * p01) >> 16);
+}
+
+/* Applies the wheel: a new pass is a measurement, a stall is zero speed */
+void speed_fusion_wheel(const speed_reading_t *reading) {
+    bool new_pass = !module.have_reading || reading->revolutions != module.last_passes;
+    module.have_reading = true;
+    module.last_passes = reading->revolutions;
+
+    if (reading->stopped) {
+        correct(0, Q16(SPEED_FUSION_STOPPED_NOISE * SPEED_FUSION_STOPPED_NOISE));
+        if (module.v < 0) module.v = 0;
+        return;
+    }
+
+    int64_t wheel = (int64_t)reading->kph_q16 * 2500 / 9;  // kph -> mm/s, Q16 kept
+    if (reading->decaying) {
+        // no new pass yet: the wheel can't be faster than the elapsed-time bound
+        if (module.v > wheel) module.v = wheel;
+    } else if (new_pass) {
+        // the Hall speed is the mean over the last period, i.e. the speed
+        // half a period before the pass: carry it forward to now
+        uint64_t age = reading->now_ticks - reading->last_edge_ticks + reading->period_ticks / 2;
+        wheel += mul_q20(module.a_avg - module.b, ticks_to_q20(age));
+        correct(wheel, Q16(SPEED_FUSION_WHEEL_NOISE * SPEED_FUSION_WHEEL_NOISE));
+    }
+}
+
+uint32_t speed_fusion_kph_q16(void) {
+    if (module.v <= 0) return 0;
+    int64_t kph = module.v * 9 / 2500;
+    return (kph > UINT32_MAX) ? UINT32_MAX : (uint32_t)kph;
+}
+
+/* Learned forward-axis offset in mg (tilt and grade show up here) */
+int32_t speed_fusion_bias_mg(void) {
+    return module.b / MG_TO_MM_S2_Q16;
+}
@@ -0,0 +1,55 @@
+/* File: speed_fusion.h
+ * --------------------
+ * Speed between magnet passes, fused from the wheel and the accelerometer.
+ *
+ * A two-state Kalman filter tracks forward speed v and the accelerometer's
+ * forward-axis offset b (gravity from mounting tilt and road grade, plus
+ * sensor bias). Every accelerometer sample predicts:
+ *
+ *     v += (a - b) * dt
+ *
+ * and every new wheel reading corrects v (and through their covariance, b)
+ * toward the Hall speed. The Hall speed is a mean over the last period, so
+ * before it is used it is carried forward from mid-period to now with the
+ * smoothed acceleration. A stopped wheel is a zero-speed measurement; while
+ * the next pass is overdue, v is also capped at speed_service's upper bound.
+ *
+ * So speed comes out at the accelerometer rate (8 ms at 125 Hz, 32 ms at
+ * 31 Hz) and follows braking within a few samples, instead of once per
+ * revolution. The first sample after a rate change, or after a gap of
+ * more than SPEED_FUSION_MAX_GAP_SAMPLES periods (e.g. between monitoring
+ * sessions), doesn't predict: its dt isn't one sample step. After a gap
+ * the speed is taken as unknown, so the next wheel reading sets it again.
+ * All fixed point: v in mm/s and b in mm/s^2, both Q16, with the
+ * covariance in Q16 and 128-bit intermediates for the products.
+ */
+
+#ifndef SPEED_FUSION_H
+#define SPEED_FUSION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "accel_sched.h"
+#include "speed_service.h"
+#include "brake_light.h"
+
+/* Same mounting as the brake light */
+#define SPEED_FUSION_AXIS            BRAKE_LIGHT_AXIS
+#define SPEED_FUSION_AXIS_SIGN       BRAKE_LIGHT_AXIS_SIGN
+
+/* Noise model, standard deviations */
+#define SPEED_FUSION_ACCEL_NOISE     2000    // mm/s^2, road vibration on the forward axis
+#define SPEED_FUSION_BIAS_DRIFT      30      // mm/s^2 per sqrt(s), tilt changes on hills
+#define SPEED_FUSION_WHEEL_NOISE     100     // mm/s, Hall speed (~0.4 kph)
+#define SPEED_FUSION_STOPPED_NOISE   20      // mm/s, wheel reports stopped
+
+/* A longer gap between samples is a break in the stream, not one step */
+#define SPEED_FUSION_MAX_GAP_SAMPLES 4
+
+void speed_fusion_init(void);
+void speed_fusion_accel(const accel_sample_t *sample);
+void speed_fusion_wheel(const speed_reading_t *reading);
+uint32_t speed_fusion_kph_q16(void);
+int32_t speed_fusion_bias_mg(void);
+
+#endif /* SPEED_FUSION_H */
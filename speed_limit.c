@@ -0,0 +1,87 @@
+/* File: speed_limit.c
+ * -------------------
+ * PID speed limiter on the control timer (see speed_limit.h).
+ */
+
+#include "speed_limit.h"
+#include "abs_task.h"
+#include "control_timer.h"
+#include "speed_service.h"
+#include "assert.h"
+#include <stddef.h>
+
+#define MAX_LEAD_Q16 ((uint32_t)SPEED_LIMIT_MAX_LEAD_KPH << 16)
+
+static struct {
+    speed_pid_t pid;
+    volatile uint32_t ceiling_kph_q16;  // 0 = off
+    volatile uint32_t lead_kph_q16;     // expected rise, taken off the ceiling
+    volatile bool new_gains;
+    speed_pid_gains_t gains;            // taken by the task on its next step
+    unsigned int written;               // last demand handed to the ABS
+} module;
+
+/* Runs every control period in interrupt context */
+static void limit_step(void *aux_data) {
+    if (module.new_gains) {
+        speed_pid_init(&module.pid, &module.gains, module.pid.rate_hz);
+        module.new_gains = false;
+    }
+
+    unsigned int force = 0;
+    uint32_t ceiling = module.ceiling_kph_q16;
+    if (ceiling) {
+        uint32_t lead = module.lead_kph_q16;
+        if (lead > MAX_LEAD_Q16) lead = MAX_LEAD_Q16;
+        ceiling = (lead < ceiling) ? ceiling - lead : 0;    // brake ahead of a climb
+        speed_reading_t reading;
+        speed_service_read_published(&reading);  // the main loop may be mid-poll
+        force = speed_pid_step(&module.pid, reading.kph_q16, ceiling);
+    } else {
+        speed_pid_reset(&module.pid);
+    }
+
+    // only touch the demand while limiting, or to let go after
+    if (force != module.written) {
+        abs_task_set_demand(force);
+        module.written = force;
+    }
+}
+
+/* Requires abs_task_init() and speed_service_init(); starts off, see speed_limit_set_ceiling() */
+void speed_limit_init(unsigned int rate_hz, const speed_pid_gains_t *gains) {
+    assert(rate_hz > 0 && 1000000 / CONTROL_TICK_US % rate_hz == 0);
+    speed_pid_init(&module.pid, gains, rate_hz);
+    module.ceiling_kph_q16 = 0;
+    module.lead_kph_q16 = 0;
+    module.new_gains = false;
+    module.written = 0;
+
+    control_timer_init();
+    bool added = control_timer_add(limit_step, NULL, 1000000 / CONTROL_TICK_US / rate_hz);
+    assert(added);
+}
+
+/* Takes effect on the next step and restarts the integral */
+void speed_limit_set_gains(const speed_pid_gains_t *gains) {
+    module.gains = *gains;
+    module.new_gains = true;    // published after the gains
+}
+
+void speed_limit_set_ceiling(unsigned int kph) {
+    module.ceiling_kph_q16 = (uint32_t)kph << 16;
+}
+
+/* Rise in speed the caller expects soon; 0 when not climbing toward the ceiling */
+void speed_limit_set_lead(uint32_t rise_kph_q16) {
+    module.lead_kph_q16 = rise_kph_q16;
+}
+
+unsigned int speed_limit_force(void) {
+    return module.written;
+}
+
+/* True while the limiter is asking for brake */
+bool speed_limit_braking(void) {
+    return module.written != 0;
+}
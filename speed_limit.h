@@ -0,0 +1,46 @@
+/* File: speed_limit.h
+ * -------------------
+ * Closed-loop speed limiter: brakes just enough to hold the bike under a
+ * ceiling.
+ *
+ * A control timer task (see control_timer.h) reads the rear wheel speed
+ * from the speed service at a fixed rate, steps the PID (speed_pid.h) and
+ * passes the force on as the ABS brake demand (abs_task.h), so the limiter
+ * can't lock the wheel either. The ABS task turns it into a servo pulse
+ * width through brake_actuator and the PWM driver.
+ *
+ *     speed_limit_init(SPEED_LIMIT_RATE_HZ, &SPEED_LIMIT_GAINS);
+ *     speed_limit_set_ceiling(SPEED_BRAKE_KPH);
+ *
+ * The main loop must keep calling speed_service_poll(); the task reads the
+ * copy each poll publishes (speed_service_read_published()) and never
+ * drains the service. A ceiling of 0 switches the limiter off.
+ * While its output is 0 the limiter leaves the brake demand alone.
+ *
+ * To brake ahead of a fast climb, the caller can pass in the rise it
+ * expects over its look-ahead with speed_limit_set_lead() (e.g. from
+ * speed_trend_predict_kph_q16()). The task then holds the bike under the
+ * ceiling less that rise, at most SPEED_LIMIT_MAX_LEAD_KPH lower, so the
+ * brake is already on when the climb would have crossed the ceiling.
+ */
+
+#ifndef SPEED_LIMIT_H
+#define SPEED_LIMIT_H
+
+#include <stdbool.h>
+#include "speed_pid.h"
+
+#define SPEED_LIMIT_RATE_HZ  50     // must divide the control tick rate
+#define SPEED_LIMIT_MAX_LEAD_KPH 3  // most a predicted climb lowers the ceiling
+
+/* Tuned on a simulated bike with one magnet and 100 ms of servo lag */
+#define SPEED_LIMIT_GAINS    ((speed_pid_gains_t){ .kp = 80, .ki = 40, .kd = 0 })
+
+void speed_limit_init(unsigned int rate_hz, const speed_pid_gains_t *gains);
+void speed_limit_set_gains(const speed_pid_gains_t *gains);
+void speed_limit_set_ceiling(unsigned int kph);
+void speed_limit_set_lead(uint32_t rise_kph_q16);
+unsigned int speed_limit_force(void);
+bool speed_limit_braking(void);
+
+#endif /* SPEED_LIMIT_H */
@@ -0,0 +1,52 @@
+/* File: speed_pid.c
+ * -----------------
+ * Integer PID speed limiter, hardware independent (see speed_pid.h).
+ */
+
+#include "speed_pid.h"
+#include "assert.h"
+
+void speed_pid_init(speed_pid_t *pid, const speed_pid_gains_t *gains, unsigned int rate_hz) {
+    assert(rate_hz > 0);
+    assert(gains->kp >= 0 && gains->ki >= 0 && gains->kd >= 0);
+    pid->gains = *gains;
+    pid->rate_hz = rate_hz;
+    pid->ki_step_q16 = ((int64_t)gains->ki << 16) / rate_hz;
+    pid->kd_rate = (int64_t)gains->kd * rate_hz;
+    // integral * ki_step >> 32 is the I term in permille; beyond full force it is windup
+    pid->integral_max_q16 = pid->ki_step_q16 ? ((int64_t)SPEED_PID_MAX_OUTPUT << 32) / pid->ki_step_q16 : 0;
+    speed_pid_reset(pid);
+}
+
+void speed_pid_reset(speed_pid_t *pid) {
+    pid->integral_q16 = 0;
+    pid->last_kph_q16 = 0;
+    pid->primed = false;
+    pid->output = 0;
+}
+
+/* One control period: returns brake force, permille */
+unsigned int speed_pid_step(speed_pid_t *pid, uint32_t kph_q16, uint32_t ceiling_kph_q16) {
+    int64_t error = (int64_t)kph_q16 - ceiling_kph_q16;
+    int64_t dv = pid->primed ? (int64_t)kph_q16 - pid->last_kph_q16 : 0;
+    pid->last_kph_q16 = kph_q16;
+    pid->primed = true;
+
+    int64_t pd_q16 = pid->gains.kp * error + pid->kd_rate * dv;
+    int64_t integral = pid->integral_q16 + error;
+    int64_t u = (pd_q16 + ((integral * pid->ki_step_q16) >> 16)) >> 16;
+
+    // conditional integration: don't push further into a limit that's already reached
+    bool windup = (u > SPEED_PID_MAX_OUTPUT && error > 0) || (u < 0 && error < 0);
+    if (!windup) {
+        if (integral < 0) integral = 0;
+        if (integral > pid->integral_max_q16) integral = pid->integral_max_q16;
+        pid->integral_q16 = integral;
+    }
+    u = (pd_q16 + ((pid->integral_q16 * pid->ki_step_q16) >> 16)) >> 16;
+
+    if (u < 0) u = 0;
+    if (u > SPEED_PID_MAX_OUTPUT) u = SPEED_PID_MAX_OUTPUT;
+    pid->output = u;
+    return pid->output;
+}
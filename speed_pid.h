@@ -0,0 +1,53 @@
+/* File: speed_pid.h
+ * -----------------
+ * Integer PID that turns speed over a ceiling into brake force.
+ *
+ * Error is measured speed minus the ceiling, so the output (permille of
+ * full brake force, 0..1000) only rises once the bike is over it:
+ *
+ *     force = Kp*e + Ki*sum(e*dt) + Kd*dv/dt
+ *
+ * Gains are whole permille per kph, per kph*s and per kph/s. The
+ * derivative is taken on the measured speed, not the error, so moving the
+ * ceiling doesn't kick the brake. Anti-windup is by conditional
+ * integration: while the output is pinned at 0 or full force and the error
+ * would push it further, the integral holds, and it is always kept within
+ * what the output range can use. So a long climb over the ceiling can't
+ * store up braking that hangs on once the bike is back under it.
+ *
+ * Speeds are Q16.16 kph as from speed_service.h. Per-rate constants are
+ * folded in at init; a step has no divides. Hardware-free, so it can be
+ * stepped against a simulated bike on the host; speed_limit.c runs it.
+ */
+
+#ifndef SPEED_PID_H
+#define SPEED_PID_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SPEED_PID_MAX_OUTPUT  1000
+
+typedef struct {
+    int kp;     // permille per kph over
+    int ki;     // permille per kph*s over
+    int kd;     // permille per kph/s of acceleration
+} speed_pid_gains_t;
+
+typedef struct {
+    speed_pid_gains_t gains;
+    unsigned int rate_hz;
+    int64_t ki_step_q16;        // ki per step, Q16
+    int64_t kd_rate;            // kd * rate, turns a per-step change into per-second
+    int64_t integral_q16;       // sum of errors, kph Q16 * steps
+    int64_t integral_max_q16;   // most the integral can usefully hold
+    uint32_t last_kph_q16;
+    bool primed;                // have a previous speed for the derivative
+    unsigned int output;
+} speed_pid_t;
+
+void speed_pid_init(speed_pid_t *pid, const speed_pid_gains_t *gains, unsigned int rate_hz);
+void speed_pid_reset(speed_pid_t *pid);
+unsigned int speed_pid_step(speed_pid_t *pid, uint32_t kph_q16, uint32_t ceiling_kph_q16);
+
+#endif /* SPEED_PID_H */
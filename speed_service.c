@@ -0,0 +1,273 @@
+/* File: speed_service.c
+ * ---------------------
+ * Non-blocking speed service with stall/zero-speed detection (see speed_service.h).
+ */
+
+#include "speed_service.h"
+#include "speed.h"
+#include "timer.h"
+#include "assert.h"
+
+// a learned gap outside 1/4..4x its nominal share means a missed or extra pulse
+#define CAL_SHARE_MIN(n)  ((1u << 16) / (4 * (n)))
+#define CAL_SHARE_MAX(n)  ((4u << 16) / (n))
+
+typedef struct {
+    bool enabled;
+    int magnets;
+    int window;                             // gaps averaged into the period
+    int slot;                               // magnet gap now being timed
+    uint32_t weight_q16[SPEED_MAX_MAGNETS]; // revolution period / gap, per gap
+    uint64_t cal_sum[SPEED_MAX_MAGNETS];    // raw gap ticks since last calibration
+    int cal_gaps;                           // whole revolutions' worth, so every gap counts equally
+    bool calibrated;                        // weights learned at least once
+    unsigned long ring[SPEED_MAX_WINDOW];   // per-gap revolution period estimates
+    uint64_t ring_sum;
+    int ring_head;                          // next slot to write
+    int ring_count;
+    bool have_edge;                         // seen at least one pass
+    uint64_t last_edge;
+    unsigned long period;                   // averaged revolution period, 0 until two passes
+    uint32_t passes;
+} wheel_t;
+
+/* What a reading needs of a wheel, so one can be taken from a copy */
+typedef struct {
+    bool moving;                // enabled, seen a pass and has a period
+    uint64_t last_edge;
+    uint32_t passes;
+    unsigned long period;
+    uint32_t slot_weight_q16;   // weight of the gap now being timed
+} wheel_view_t;
+
+static struct {
+    unsigned long stall_ticks;
+    bool hw_capture;            // prefer hardware-latched period from PWM capture (rear only)
+    uint64_t recip_q32[SPEED_MAX_WINDOW + 1];   // 2^32 / k, so averaging needs no divide
+    wheel_t wheels[HALL_WHEEL_COUNT];
+    wheel_view_t published[2];  // rear wheel as of the last poll, for interrupt context
+    volatile int current;       // which copy readers take
+} module;
+
+static void wheel_reset_history(wheel_t *w) {
+    w->ring_sum = 0;
+    w->ring_head = 0;
+    w->ring_count = 0;
+    w->period = 0;
+    w->cal_gaps = 0;
+    for (int i = 0; i < w->magnets; i++) {
+        w->cal_sum[i] = 0;
+    }
+}
+
+void speed_service_config_wheel(hall_wheel_t wheel, int magnets, int window) {
+    assert(wheel < HALL_WHEEL_COUNT);
+    assert(magnets >= 1 && magnets <= SPEED_MAX_MAGNETS);
+    assert(window >= 1 && window <= SPEED_MAX_WINDOW);
+    wheel_t *w = &module.wheels[wheel];
+    w->enabled = true;
+    w->magnets = magnets;
+    w->window = window;
+    w->slot = 0;
+    for (int i = 0; i < magnets; i++) {
+        w->weight_q16[i] = (uint32_t)magnets << 16;    // evenly spaced until calibrated
+    }
+    w->calibrated = false;
+    w->have_edge = false;
+    w->passes = 0;
+    wheel_reset_history(w);
+}
+
+void speed_service_init(unsigned int stall_timeout_ms, bool hw_capture) {
+    module.stall_ticks = (unsigned long)stall_timeout_ms * 1000 * TICKS_PER_USEC;
+    module.hw_capture = hw_capture;
+    for (int k = 1; k <= SPEED_MAX_WINDOW; k++) {
+        module.recip_q32[k] = ((1ULL << 32) + k - 1) / k;
+    }
+    for (int i = 0; i < HALL_WHEEL_COUNT; i++) {
+        module.wheels[i].enabled = false;
+    }
+    speed_service_config_wheel(HALL_WHEEL_REAR, 1, 1);
+    module.published[0].moving = false;
+    module.current = 0;
+}
+
+static void wheel_update_period(wheel_t *w) {
+    w->period = ((unsigned __int128)w->ring_sum * module.recip_q32[w->ring_count]) >> 32;
+}
+
+static void wheel_push_estimate(wheel_t *w, unsigned long rev_period) {
+    if (w->ring_count == w->window) {
+        w->ring_sum -= w->ring[w->ring_head];
+    } else {
+        w->ring_count++;
+    }
+    w->ring[w->ring_head] = rev_period;
+    w->ring_sum += rev_period;
+    if (++w->ring_head == w->window) w->ring_head = 0;
+    wheel_update_period(w);
+}
+
+/* Swaps in a better measurement of the gap just pushed */
+static void wheel_replace_newest(wheel_t *w, unsigned long rev_period) {
+    int newest = (w->ring_head == 0) ? w->window - 1 : w->ring_head - 1;
+    w->ring_sum += rev_period;
+    w->ring_sum -= w->ring[newest];
+    w->ring[newest] = rev_period;
+    wheel_update_period(w);
+}
+
+/*
+ * Each gap's share of a revolution is its summed time over SPEED_CAL_REVS
+ * revolutions divided by the total. Divides happen here, once per few
+ * revolutions, so the per-pass path stays multiply-only. After the first
+ * batch, new weights are blended 1:1 with the old so one bad batch can't
+ * swing them far.
+ */
+static void wheel_calibrate(wheel_t *w) {
+    uint64_t total = 0;
+    for (int i = 0; i < w->magnets; i++) {
+        total += w->cal_sum[i];
+    }
+    bool plausible = (total != 0);
+    for (int i = 0; i < w->magnets && plausible; i++) {
+        uint64_t share_q16 = (w->cal_sum[i] << 16) / total;
+        plausible = share_q16 >= CAL_SHARE_MIN(w->magnets) && share_q16 <= CAL_SHARE_MAX(w->magnets);
+    }
+    if (plausible) {
+        for (int i = 0; i < w->magnets; i++) {
+            uint32_t weight = (total << 16) / w->cal_sum[i];
+            w->weight_q16[i] = w->calibrated ? (w->weight_q16[i] + weight) >> 1 : weight;
+        }
+        w->calibrated = true;
+    }
+    w->cal_gaps = 0;
+    for (int i = 0; i < w->magnets; i++) {
+        w->cal_sum[i] = 0;
+    }
+}
+
+static void wheel_pass(wheel_t *w, uint64_t pass) {
+    int slot = w->slot;     // the gap that this pass closes
+    if (w->have_edge) {
+        unsigned long gap = pass - w->last_edge;
+        if (gap > module.stall_ticks) {
+            // a long gap is a restart from standstill, not a revolution period
+            wheel_reset_history(w);
+        } else {
+            wheel_push_estimate(w, ((uint64_t)gap * w->weight_q16[slot]) >> 16);
+            w->cal_sum[slot] += gap;
+            if (w->magnets > 1 && ++w->cal_gaps == SPEED_CAL_REVS * w->magnets) {
+                wheel_calibrate(w);
+            }
+        }
+    }
+    w->slot = (slot + 1 == w->magnets) ? 0 : slot + 1;
+    w->last_edge = pass;
+    w->have_edge = true;
+    w->passes++;
+}
+
+static wheel_view_t wheel_view(const wheel_t *w) {
+    return (wheel_view_t){
+        .moving = w->enabled && w->have_edge && w->period != 0,
+        .last_edge = w->last_edge,
+        .passes = w->passes,
+        .period = w->period,
+        .slot_weight_q16 = w->weight_q16[w->slot],
+    };
+}
+
+/*
+ * Handlers can't be waited out, so instead of a lock there are two
+ * copies: the poll fills the one readers aren't using, then flips. A
+ * handler runs to completion before the main loop writes again, so the
+ * copy it reads can't change under it.
+ */
+static void publish_rear(void) {
+    int next = !module.current;
+    module.published[next] = wheel_view(&module.wheels[HALL_WHEEL_REAR]);
+    __sync_synchronize();   // copy complete before the flip
+    module.current = next;
+}
+
+/* Drain pending pulses; never waits */
+void speed_service_poll(void) {
+    for (int i = 0; i < HALL_WHEEL_COUNT; i++) {
+        wheel_t *w = &module.wheels[i];
+        if (!w->enabled) continue;
+        uint64_t pass;
+        while (hall_capture_pop_wheel(i, &pass)) {
+            wheel_pass(w, pass);
+        }
+    }
+
+    wheel_t *rear = &module.wheels[HALL_WHEEL_REAR];
+    unsigned long hw_gap;
+    if (module.hw_capture && rear->period && hall_capture_hw_period(&hw_gap)) {
+        int closed = (rear->slot == 0) ? rear->magnets - 1 : rear->slot - 1;
+        wheel_replace_newest(rear, ((uint64_t)hw_gap * rear->weight_q16[closed]) >> 16);
+    }
+    publish_rear();
+}
+
+static void read_view(const wheel_view_t *w, speed_reading_t *reading) {
+    uint64_t now = timer_get_ticks();
+    reading->now_ticks = now;
+    reading->last_edge_ticks = w->last_edge;
+    reading->revolutions = w->passes;
+    reading->decaying = false;
+
+    unsigned long since_edge = now - w->last_edge;
+    if (!w->moving || since_edge >= module.stall_ticks) {
+        reading->stopped = true;
+        reading->period_ticks = 0;
+        reading->kph_q16 = 0;
+        return;
+    }
+
+    reading->stopped = false;
+    reading->period_ticks = w->period;
+    // next pass is overdue: the wheel is slower than this gap scaled to a revolution
+    unsigned long bound = ((uint64_t)since_edge * w->slot_weight_q16) >> 16;
+    if (bound > w->period) {
+        reading->period_ticks = bound;
+        reading->decaying = true;
+    }
+    reading->kph_q16 = speed_kph_q16(reading->period_ticks);
+}
+
+void speed_service_read_wheel(hall_wheel_t wheel, speed_reading_t *reading) {
+    assert(wheel < HALL_WHEEL_COUNT);
+    wheel_view_t view = wheel_view(&module.wheels[wheel]);
+    read_view(&view, reading);
+}
+
+void speed_service_read(speed_reading_t *reading) {
+    speed_service_read_wheel(HALL_WHEEL_REAR, reading);
+}
+
+/*
+ * Rear wheel as of the last speed_service_poll(), safe from interrupt
+ * context (e.g. a control timer task) while the main loop polls.
+ */
+void speed_service_read_published(speed_reading_t *reading) {
+    read_view(&module.published[module.current], reading);
+}
+
+/*
+ * Rear speed relative to front, in parts per thousand: positive when the
+ * rear spins faster than the road (drive slip), negative when it turns
+ * slower (skid under braking). Both wheels are assumed WHEEL_DIAMETER_IN.
+ * v_rear / v_front = T_front / T_rear, so this is one divide per call.
+ */
+bool speed_service_slip_permille(int *slip) {
+    speed_reading_t rear, front;
+    speed_service_read_wheel(HALL_WHEEL_REAR, &rear);
+    speed_service_read_wheel(HALL_WHEEL_FRONT, &front);
+    if (rear.stopped || front.stopped) return false;
+
+    int64_t diff = (int64_t)front.period_ticks - (int64_t)rear.period_ticks;
+    *slip = (diff * 1000) / (int64_t)rear.period_ticks;
+    return true;
+}
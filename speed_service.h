@@ -0,0 +1,69 @@
+/* File: speed_service.h
+ * ---------------------
+ * Non-blocking wheel speed service with stall detection.
+ *
+ * speed_service_poll() drains the Hall pulse queue (see hall_capture.h) and
+ * returns immediately whether or not the wheel has moved. Readings are
+ * always current:
+ *
+ * - right after a magnet pass, speed comes from the last revolution period;
+ * - once more time has passed since the last edge than that period, the
+ *   wheel must be turning slower than one revolution per elapsed time, so
+ *   the reported speed decays as that upper bound;
+ * - after stall_timeout_ms with no edge, speed is declared zero.
+ *
+ * Each reading carries the tick time of the last edge so callers can judge
+ * how fresh it is.
+ *
+ * The service's state belongs to the main loop, which changes it in
+ * speed_service_poll(). Code in interrupt context must not call
+ * speed_service_read(), which could see a half-updated wheel. It calls
+ * speed_service_read_published() instead, which reads the copy of the
+ * rear wheel that each poll publishes.
+ *
+ * A wheel may carry up to SPEED_MAX_MAGNETS magnets, giving that many
+ * updates per revolution. Every pass-to-pass gap is scaled to a full
+ * revolution period by a per-gap weight; the weights start from even
+ * spacing and are learned from the measured gaps every SPEED_CAL_REVS
+ * revolutions, so magnets need not be placed exactly. The reported period
+ * is the mean of the last `window` scaled gaps; a window that is a multiple
+ * of the magnet count cancels any remaining placement error exactly.
+ *
+ * The rear wheel is always sensed (speed_service_init() sets it up with one
+ * magnet); a front wheel can be added with speed_service_config_wheel()
+ * once hall_capture_init_wheel() has set up its pin. With both wheels
+ * sensed, speed_service_slip_permille() gives the rear wheel slip ratio.
+ */
+
+#ifndef SPEED_SERVICE_H
+#define SPEED_SERVICE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "hall_capture.h"
+
+#define SPEED_STALL_TIMEOUT_MS  3000    // 26", one magnet: below ~2.5 kph reads as stopped
+#define SPEED_MAGNETS_PER_WHEEL 1       // as fitted on the bike
+#define SPEED_MAX_MAGNETS       8
+#define SPEED_MAX_WINDOW        16      // gaps averaged into one period
+#define SPEED_CAL_REVS          8       // revolutions per spacing calibration update
+
+typedef struct {
+    uint32_t kph_q16;           // Q16.16 kph, 0 when stopped
+    unsigned long period_ticks; // revolution period behind kph_q16 (measured or elapsed), 0 when stopped
+    uint64_t last_edge_ticks;   // when the last magnet pass was seen
+    uint64_t now_ticks;         // when this reading was taken
+    uint32_t revolutions;       // total magnet passes seen, changes on each new pass
+    bool decaying;              // kph_q16 is the time-since-last-edge upper bound
+    bool stopped;               // no edge within the stall timeout
+} speed_reading_t;
+
+void speed_service_init(unsigned int stall_timeout_ms, bool hw_capture);
+void speed_service_config_wheel(hall_wheel_t wheel, int magnets, int window);
+void speed_service_poll(void);
+void speed_service_read(speed_reading_t *reading);
+void speed_service_read_published(speed_reading_t *reading);
+void speed_service_read_wheel(hall_wheel_t wheel, speed_reading_t *reading);
+bool speed_service_slip_permille(int *slip);
+
+#endif /* SPEED_SERVICE_H */
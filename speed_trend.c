@@ -0,0 +1,117 @@
+/* File: speed_trend.c
+ * -------------------
+ * O(1) least-squares speed slope over recent wheel pulses (see speed_trend.h).
+ */
+
+#include "speed_trend.h"
+#include "timer.h"
+
+#define TREND_MASK       (SPEED_TREND_LEN - 1)
+#define TICKS_PER_MS     (1000 * TICKS_PER_USEC)
+#define REBASE_MS        (1L << 20)     // ~17 minutes: keeps the sums in 64 bits
+#define MAX_KPH_Q16      (1L << 23)     // 128 kph, anything faster is clamped
+_Static_assert((SPEED_TREND_LEN & TREND_MASK) == 0, "SPEED_TREND_LEN must be a power of two");
+
+static struct {
+    uint64_t base_ticks;                // time origin of the stored t values
+    int64_t t[SPEED_TREND_LEN];         // ms since base_ticks
+    int64_t v[SPEED_TREND_LEN];         // kph Q16
+    unsigned int head;                  // total points added since reset
+    int n;
+    int64_t sum_t, sum_v, sum_tt, sum_tv;
+    int32_t slope_q16;                  // kph/s, Q16
+} module;
+
+void speed_trend_reset(void) {
+    module.base_ticks = timer_get_ticks();
+    module.head = 0;
+    module.n = 0;
+    module.sum_t = module.sum_v = module.sum_tt = module.sum_tv = 0;
+    module.slope_q16 = 0;
+}
+
+void speed_trend_init(void) {
+    speed_trend_reset();
+}
+
+/*
+ * Moves the time origin forward by c ms. The sums follow from
+ * sum (t-c) = sum t - n*c, sum (t-c)^2 = sum t^2 - 2c sum t + n*c^2 and
+ * sum (t-c)*v = sum t*v - c sum v; only the stored points need a pass.
+ */
+static void rebase(int64_t c) {
+    module.sum_tt += -2 * c * module.sum_t + module.n * c * c;
+    module.sum_tv -= c * module.sum_v;
+    module.sum_t -= module.n * c;
+    for (int i = 0; i < SPEED_TREND_LEN; i++) {
+        module.t[i] -= c;
+    }
+    module.base_ticks += (uint64_t)c * TICKS_PER_MS;
+}
+
+static void update_slope(void) {
+    int64_t n = module.n;
+    if (n < SPEED_TREND_MIN_POINTS) {
+        module.slope_q16 = 0;
+        return;
+    }
+    // with t < 2^20 ms and v < 2^23 every term below stays under 2^60
+    int64_t num = n * module.sum_tv - module.sum_t * module.sum_v;
+    int64_t den = n * module.sum_tt - module.sum_t * module.sum_t;
+    if (den <= 0) {     // all points at the same ms
+        module.slope_q16 = 0;
+        return;
+    }
+    int64_t slope = num * 1000 / den;   // Q16 kph per ms -> per s
+    if (slope > INT32_MAX) slope = INT32_MAX;
+    if (slope < INT32_MIN) slope = INT32_MIN;
+    module.slope_q16 = (int32_t)slope;
+}
+
+/* Adds the speed measured at a magnet pass; retires the oldest point once full */
+void speed_trend_add(uint64_t edge_ticks, uint32_t kph_q16) {
+    int64_t t = (int64_t)((edge_ticks - module.base_ticks) / TICKS_PER_MS);
+    if (t > REBASE_MS) {
+        int64_t oldest = module.n ? module.t[(module.head - module.n) & TREND_MASK] : t;
+        rebase(oldest);
+        t -= oldest;
+    }
+
+    unsigned int slot = module.head & TREND_MASK;
+    if (module.n == SPEED_TREND_LEN) {
+        int64_t t0 = module.t[slot], v0 = module.v[slot];
+        module.sum_t -= t0;
+        module.sum_v -= v0;
+        module.sum_tt -= t0 * t0;
+        module.sum_tv -= t0 * v0;
+    } else {
+        module.n++;
+    }
+    int64_t v = (kph_q16 < MAX_KPH_Q16) ? kph_q16 : MAX_KPH_Q16;
+    module.t[slot] = t;
+    module.v[slot] = v;
+    module.sum_t += t;
+    module.sum_v += v;
+    module.sum_tt += t * t;
+    module.sum_tv += t * v;
+    module.head++;
+    update_slope();
+}
+
+bool speed_trend_valid(void) {
+    return module.n >= SPEED_TREND_MIN_POINTS;
+}
+
+/* Fitted acceleration in kph per second, Q16; negative when slowing, 0 until valid */
+int32_t speed_trend_accel_q16(void) {
+    return module.slope_q16;
+}
+
+/* Latest speed extrapolated horizon_ms ahead along the fitted slope, clamped at 0 */
+uint32_t speed_trend_predict_kph_q16(unsigned int horizon_ms) {
+    if (module.n == 0) return 0;
+    int64_t latest = module.v[(module.head - 1) & TREND_MASK];
+    int64_t predicted = latest + (int64_t)module.slope_q16 * horizon_ms / 1000;
+    if (predicted < 0) return 0;
+    return (predicted > UINT32_MAX) ? UINT32_MAX : (uint32_t)predicted;
+}
@@ -0,0 +1,37 @@
+/* File: speed_trend.h
+ * -------------------
+ * Wheel acceleration/deceleration from the recent pulse history.
+ *
+ * Each magnet pass adds a (time, speed) point to a ring of the last
+ * SPEED_TREND_LEN points. The least-squares slope of speed against time is
+ * kept up to date from running sums (n, sum t, sum v, sum t*t, sum t*v):
+ * adding a point and retiring the oldest is a handful of integer
+ * multiply/adds, so the update is O(1) per pulse however long the window.
+ *
+ * Times are milliseconds relative to a base that is moved forward (and the
+ * sums adjusted) long before the squares could overflow.
+ *
+ * The slope lets the caller brake on where speed is heading:
+ * speed_trend_predict_kph_q16() extrapolates the latest speed over a
+ * horizon, so a fast climb toward the brake band triggers before the band
+ * is actually reached.
+ */
+
+#ifndef SPEED_TREND_H
+#define SPEED_TREND_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SPEED_TREND_LEN          8      // points in the fit, must be a power of two
+#define SPEED_TREND_MIN_POINTS   3      // fewer than this and there is no slope
+#define SPEED_TREND_HORIZON_MS   1000   // look-ahead for predictive braking
+
+void speed_trend_init(void);
+void speed_trend_reset(void);
+void speed_trend_add(uint64_t edge_ticks, uint32_t kph_q16);
+bool speed_trend_valid(void);
+int32_t speed_trend_accel_q16(void);
+uint32_t speed_trend_predict_kph_q16(unsigned int horizon_ms);
+
+#endif /* SPEED_TREND_H */
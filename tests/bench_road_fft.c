@@ -0,0 +1,97 @@
+/* File: bench_road_fft.c
+ * ----------------------
+ * Host benchmark for road_fft: times full blocks through road_fft_push()
+ * with a real clock and reports them against ROAD_FFT_BUDGET_CYCLES.
+ *
+ * Built at the target's -Og. The host is a wide out-of-order core, so its
+ * cycle count is a floor for the in-order C906, not a prediction: a block
+ * well inside the budget here has headroom for the stalls the budget
+ * allows for, one near it does not. road_fft's own max/overrun counters
+ * run off timer_get_ticks(), which here is the host clock at the target's
+ * 24 ticks per usec, so they are checked the same way as on the board.
+ *
+ * Run with make -C tests bench (or make bench from the top directory).
+ */
+
+#include "road_fft.h"
+#include "timer.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BLOCKS        20000
+#define TARGET_MHZ    1000      // C906 clock the budget is stated at
+
+static uint64_t block_ns[BLOCKS];
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+unsigned long timer_get_ticks(void) {
+    return now_ns() * TICKS_PER_USEC / 1000;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_CYCLES 1
+static uint64_t now_cycles(void) {
+    return __rdtsc();
+}
+#else
+#define HAVE_CYCLES 0
+static uint64_t now_cycles(void) {
+    return 0;
+}
+#endif
+
+int main(void) {
+    road_fft_init();
+    srand(27);
+
+    // one block's worth of road noise on top of gravity, pushed repeatedly
+    int samples[ROAD_FFT_N];
+    for (int n = 0; n < ROAD_FFT_N; n++) {
+        samples[n] = 1000 + lround(600 * sin(2 * M_PI * 9 * n / ROAD_FFT_N)) + rand() % 401 - 200;
+    }
+
+    uint64_t total_ns = 0, total_cycles = 0;
+    for (int b = 0; b < BLOCKS; b++) {
+        for (int n = 0; n < ROAD_FFT_N - 1; n++) {
+            road_fft_push(samples[n]);
+        }
+        // the last push runs the FFT and the feature update
+        uint64_t c0 = now_cycles(), t0 = now_ns();
+        bool done = road_fft_push(samples[ROAD_FFT_N - 1]);
+        uint64_t t1 = now_ns(), c1 = now_cycles();
+        if (!done) {
+            printf("block %d didn't complete\n", b);
+            return 1;
+        }
+        block_ns[b] = t1 - t0;
+        total_ns += t1 - t0;
+        total_cycles += c1 - c0;
+    }
+    // the worst includes the host scheduler stepping in, the median doesn't
+    qsort(block_ns, BLOCKS, sizeof(block_ns[0]), compare_u64);
+
+    double budget_us = (double)ROAD_FFT_BUDGET_CYCLES / TARGET_MHZ;
+    printf("road_fft %d-point, %d blocks on the host:\n", ROAD_FFT_N, BLOCKS);
+    printf("  mean %.2f us, median %.2f us, worst %.2f us per block (budget %.0f us = %d cycles at %d MHz)\n",
+           total_ns / 1000.0 / BLOCKS, block_ns[BLOCKS / 2] / 1000.0, block_ns[BLOCKS - 1] / 1000.0,
+           budget_us, ROAD_FFT_BUDGET_CYCLES, TARGET_MHZ);
+    if (HAVE_CYCLES) {
+        printf("  mean %llu host cycles per block, %.1f%% of the budget\n",
+               (unsigned long long)(total_cycles / BLOCKS), 100.0 * total_cycles / BLOCKS / ROAD_FFT_BUDGET_CYCLES);
+    }
+    printf("  road_fft_max_us() %u, road_fft_overruns() %u\n", road_fft_max_us(), road_fft_overruns());
+    return 0;
+}
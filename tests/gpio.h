@@ -0,0 +1,17 @@
+/* File: gpio.h
+ * ------------
+ * Host stand-in for the CS107E gpio module: just the pin ids, for headers
+ * that name pins (hall_capture.h, pwm.h).
+ */
+
+#ifndef GPIO_H
+#define GPIO_H
+
+#include <stdbool.h>
+
+typedef enum {
+    GPIO_PB0 = 0x100, GPIO_PB1, GPIO_PB2, GPIO_PB3, GPIO_PB4, GPIO_PB5, GPIO_PB6, GPIO_PB7,
+    GPIO_PC0 = 0x200, GPIO_PC1,
+} gpio_id_t;
+
+#endif /* GPIO_H */
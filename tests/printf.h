@@ -0,0 +1,11 @@
+/* File: printf.h
+ * --------------
+ * Host stand-in for the CS107E printf module.
+ */
+
+#ifndef PRINTF_H
+#define PRINTF_H
+
+#include <stdio.h>
+
+#endif /* PRINTF_H */
@@ -0,0 +1,11 @@
+/* File: strings.h
+ * ---------------
+ * Host stand-in for the CS107E strings module (memcpy and friends).
+ */
+
+#ifndef STRINGS_H
+#define STRINGS_H
+
+#include <string.h>
+
+#endif /* STRINGS_H */
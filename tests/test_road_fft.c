@@ -0,0 +1,95 @@
+/* File: test_road_fft.c
+ * ---------------------
+ * Checks the Q15 real FFT in road_fft.c against a double-precision DFT.
+ *
+ * road_fft_real() scales by 1/M (M = N/2), so |X[k]| should match the
+ * DFT magnitude divided by M to within the rounding of the Q15 stages.
+ */
+
+#include "road_fft.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define N ROAD_FFT_N
+#define M (N / 2)
+// allowed |X[k]| error, input units: half a unit per halving stage
+// (LOG2N of them, split step included) plus the twiddle rounding
+#define TOLERANCE_MG (ROAD_FFT_LOG2N / 2.0 + 0.5)
+
+unsigned long timer_get_ticks(void) {
+    return 0;
+}
+
+static int failures;
+
+/* Worst magnitude error over all bins, in input units */
+static double worst_error(const int16_t *in) {
+    uint64_t power[ROAD_FFT_BINS];
+    road_fft_real(in, power);
+
+    double worst = 0;
+    for (int k = 0; k <= M; k++) {
+        double re = 0, im = 0;
+        for (int n = 0; n < N; n++) {
+            re += in[n] * cos(2 * M_PI * k * n / N);
+            im -= in[n] * sin(2 * M_PI * k * n / N);
+        }
+        double expect = sqrt(re * re + im * im) / M;
+        double err = fabs(sqrt((double)power[k]) - expect);
+        if (err > worst) worst = err;
+    }
+    return worst;
+}
+
+static void check(const char *name, const int16_t *in) {
+    double err = worst_error(in);
+    bool ok = err <= TOLERANCE_MG;
+    printf("%-28s worst |X[k]| error %.2f mg %s\n", name, err, ok ? "ok" : "FAIL");
+    if (!ok) failures++;
+}
+
+int main(void) {
+    int16_t in[N];
+
+    // a tone centred on each band, at road-vibration amplitudes
+    int bins[] = { 3, M / 8 + 2, M / 4 + 5, M / 2 + 7, M };
+    for (int i = 0; i < sizeof(bins) / sizeof(bins[0]); i++) {
+        for (int n = 0; n < N; n++) {
+            in[n] = lround(800 * cos(2 * M_PI * bins[i] * n / N + 0.3));
+        }
+        char name[32];
+        snprintf(name, sizeof(name), "tone, bin %d", bins[i]);
+        check(name, in);
+    }
+
+    // between bins, so the energy leaks across the spectrum
+    for (int n = 0; n < N; n++) {
+        in[n] = lround(1500 * sin(2 * M_PI * 10.5 * n / N));
+    }
+    check("tone, bin 10.5", in);
+
+    // two tones near full scale of what the sensor reports (+/-4 g range)
+    for (int n = 0; n < N; n++) {
+        in[n] = lround(2500 * sin(2 * M_PI * 5 * n / N) + 1200 * cos(2 * M_PI * 40 * n / N));
+    }
+    check("two tones, 3700 mg peak", in);
+
+    for (int n = 0; n < N; n++) {
+        in[n] = (n == 17) ? 4000 : 0;
+    }
+    check("impulse", in);
+
+    srand(107);
+    for (int n = 0; n < N; n++) {
+        in[n] = rand() % 2001 - 1000;
+    }
+    check("noise, +/-1000 mg", in);
+
+    if (failures) {
+        printf("%d FAILED\n", failures);
+        return 1;
+    }
+    printf("road_fft: all passed\n");
+    return 0;
+}
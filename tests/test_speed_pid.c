@@ -0,0 +1,103 @@
+/* File: test_speed_pid.c
+ * ----------------------
+ * Step response of the speed limiter PID (speed_pid.c) against a
+ * simulated bike, with the gains and rate speed_limit.c runs it at.
+ *
+ * The bike is rider plus frame under a steady push (a step disturbance
+ * from 8 kph, well under the ceiling), air drag and the brake. The brake
+ * force follows the PID output through the servo's lag. Speed is measured
+ * the way speed_service.c does it: one magnet, the last pass-to-pass
+ * period, or the time since the last pass once that is longer.
+ *
+ * The bounds come from the loop, not from a run: the limiter gets one
+ * reading a revolution (REV_S, over half a second at the ceiling) and
+ * acts a control step later through a servo that takes three time
+ * constants to reach 95% of a change. So the push may go unchecked for
+ * at most UNCHECKED_S = REV_S + a step + 3 servo lags past the ceiling,
+ * and from crossing it the bike must be back within SETTLE_BAND_KPH, and
+ * stay there, within SETTLE_REVS readings. Halving or doubling either of
+ * SPEED_LIMIT_GAINS, or scaling both by a quarter, breaks one bound or
+ * the other.
+ */
+
+#include "speed_limit.h"
+#include <math.h>
+#include <stdio.h>
+
+#define CEILING_KPH      13
+#define START_KPH        8
+#define SETTLE_BAND_KPH  0.5
+#define SETTLE_REVS      12
+#define RUN_S            30.0
+
+#define MASS_KG          90.0
+#define BRAKE_MAX_N      (0.6 * 0.8 * MASS_KG * 9.81)   // rear wheel, dry road
+#define DRAG_PER_V2      0.005                          // m/s^2 per (m/s)^2
+#define SERVO_LAG_S      0.1
+#define WHEEL_M          2.07                           // 26" circumference
+#define SIM_DT           0.0005
+
+#define REV_S            (WHEEL_M / (CEILING_KPH / 3.6))
+#define UNCHECKED_S      (REV_S + 1.0 / SPEED_LIMIT_RATE_HZ + 3 * SERVO_LAG_S)
+
+static int failures;
+
+static void run(double push) {
+    speed_pid_t pid;
+    speed_pid_init(&pid, &SPEED_LIMIT_GAINS, SPEED_LIMIT_RATE_HZ);
+    const double step_s = 1.0 / SPEED_LIMIT_RATE_HZ;
+
+    double v = START_KPH / 3.6, dist = 0, brake = 0;
+    double last_pass = -1, period = 0, next_step = 0;
+    double max_kph = 0, last_outside = 0, crossed = -1;
+    unsigned int force = 0;
+
+    for (double t = 0; t < RUN_S; t += SIM_DT) {
+        brake += (force / (double)SPEED_PID_MAX_OUTPUT - brake) * SIM_DT / SERVO_LAG_S;
+        v += (push - brake * BRAKE_MAX_N / MASS_KG - DRAG_PER_V2 * v * v) * SIM_DT;
+        if (v < 0) v = 0;
+        double before = dist;
+        dist += v * SIM_DT;
+        if (floor(before / WHEEL_M) != floor(dist / WHEEL_M)) {
+            if (last_pass >= 0) period = t - last_pass;
+            last_pass = t;
+        }
+
+        if (t >= next_step) {
+            next_step += step_s;
+            double measured = 0;
+            if (period > 0) {
+                double p = (t - last_pass > period) ? t - last_pass : period;
+                measured = WHEEL_M / p * 3.6;
+            }
+            force = speed_pid_step(&pid, (uint32_t)(measured * 65536), (uint32_t)CEILING_KPH << 16);
+        }
+
+        double kph = v * 3.6;
+        if (kph > max_kph) max_kph = kph;
+        if (crossed < 0 && kph > CEILING_KPH) crossed = t;
+        if (fabs(kph - CEILING_KPH) > SETTLE_BAND_KPH) last_outside = t;
+    }
+
+    double overshoot = max_kph - CEILING_KPH;
+    double settle_revs = (last_outside - crossed) / REV_S;
+    bool ok = crossed >= 0 && overshoot <= push * 3.6 * UNCHECKED_S && settle_revs <= SETTLE_REVS;
+    printf("push %.1f m/s^2: overshoot %.2f kph (%.2f s unchecked, max %.2f), settled in %.1f revs (max %d) %s\n",
+           push, overshoot, overshoot / (push * 3.6), UNCHECKED_S, settle_revs, SETTLE_REVS, ok ? "ok" : "FAIL");
+    if (!ok) failures++;
+}
+
+int main(void) {
+    // gentle pedalling up to a hard sprint or a steep descent
+    double pushes[] = { 0.3, 0.6, 1.0, 1.5 };
+    for (int i = 0; i < sizeof(pushes) / sizeof(pushes[0]); i++) {
+        run(pushes[i]);
+    }
+
+    if (failures) {
+        printf("%d FAILED\n", failures);
+        return 1;
+    }
+    printf("speed_pid: all passed\n");
+    return 0;
+}
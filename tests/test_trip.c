@@ -0,0 +1,119 @@
+/* File: test_trip.c
+ * -----------------
+ * Checks trip.c's lifetime totals through the record store: checkpoints
+ * round-trip, alternate between the two slots, and a reboot picks up the
+ * newest valid record (the older one if the newest is damaged).
+ */
+
+#include "trip.h"
+#include "record_store.h"
+#include "speed.h"
+#include "timer.h"
+#include <stdio.h>
+#include <string.h>
+
+#define TICKS_PER_SEC (1000000UL * TICKS_PER_USEC)
+#define RECORD_BYTES  28        // trip.c's record
+
+static unsigned long now;
+static int failures;
+
+unsigned long timer_get_ticks(void) {
+    return now;
+}
+
+static bool slot_read(int slot, void *buf, size_t len) {
+    return record_store_read(RECORD_STORE_TRIP, slot, buf, len);
+}
+
+static bool slot_write(int slot, const void *buf, size_t len) {
+    return record_store_write(RECORD_STORE_TRIP, slot, buf, len);
+}
+
+static const trip_storage_t storage = { .read = slot_read, .write = slot_write };
+
+static void expect(const char *what, bool ok) {
+    printf("%-52s %s\n", what, ok ? "ok" : "FAIL");
+    if (!ok) failures++;
+}
+
+/*
+ * Rides `revs` revolutions at ten a second (~75 kph), then stops, which
+ * checkpoints; rides here stay under TRIP_CHECKPOINT_MS, so that is the
+ * only checkpoint.
+ */
+static void ride(int revs, uint32_t *revolutions) {
+    speed_reading_t r = { .kph_q16 = 75 << 16, .stopped = false };
+    for (int i = 0; i < revs; i++) {
+        now += TICKS_PER_SEC / 10;
+        r.now_ticks = now;
+        r.revolutions = ++*revolutions;
+        trip_update(&r);
+    }
+    now += TICKS_PER_SEC;
+    r = (speed_reading_t){ .now_ticks = now, .revolutions = *revolutions, .stopped = true };
+    trip_update(&r);
+}
+
+static bool slot_seq(int slot, uint32_t *seq) {
+    uint8_t rec[RECORD_BYTES];
+    if (!record_store_read(RECORD_STORE_TRIP, slot, rec, sizeof(rec))) return false;
+    memcpy(seq, rec + 8, sizeof(*seq));     // after magic, version, checksum
+    return true;
+}
+
+static void reboot(void) {
+    trip_init(1);
+    trip_set_storage(&storage);
+}
+
+int main(void) {
+    uint32_t revolutions = 0, seq0, seq1;
+    trip_summary_t total;
+    record_store_init();
+    reboot();
+    speed_reading_t at_rest = { .now_ticks = now, .stopped = true };
+    trip_update(&at_rest);      // revolution count to measure from
+    trip_lifetime(&total);
+    expect("empty store: totals start at zero", total.distance_m == 0 && total.brake_events == 0);
+
+    // 500 revolutions of a 26" wheel, just over a kilometre
+    ride(500, &revolutions);
+    trip_note_brake();
+    expect("first checkpoint goes to slot 0", slot_seq(0, &seq0) && !slot_seq(1, &seq1));
+    expect("brake event alone is written", trip_checkpoint() && slot_seq(1, &seq1) && seq1 == seq0 + 1);
+    expect("nothing new, nothing written", !trip_checkpoint());
+
+    ride(250, &revolutions);
+    expect("third checkpoint is back in slot 0", slot_seq(0, &seq0) && seq0 == seq1 + 1);
+
+    trip_summary_t before;
+    trip_lifetime(&before);
+    uint32_t expect_m = (uint64_t)750 * WHEEL_CIRC_UM / 1000000;
+    expect("lifetime distance adds up the rides", before.distance_m == expect_m);
+
+    reboot();
+    trip_lifetime(&total);
+    expect("reboot: totals round-trip", memcmp(&total, &before, sizeof(total)) == 0);
+
+    // the next checkpoint must not overwrite the record it loaded from
+    ride(100, &revolutions);
+    expect("after reboot the write goes to the older slot", slot_seq(1, &seq1) && seq1 == seq0 + 1);
+    trip_lifetime(&before);
+
+    // damage the newest record: the one before it wins
+    uint8_t rec[RECORD_BYTES];
+    record_store_read(RECORD_STORE_TRIP, 1, rec, sizeof(rec));
+    rec[12] ^= 0x40;
+    record_store_write(RECORD_STORE_TRIP, 1, rec, sizeof(rec));
+    reboot();
+    trip_lifetime(&total);
+    expect("damaged newest slot: the older record loads", total.distance_m == expect_m && total.brake_events == 1);
+
+    if (failures) {
+        printf("%d FAILED\n", failures);
+        return 1;
+    }
+    printf("trip: all passed\n");
+    return 0;
+}
@@ -0,0 +1,15 @@
+/* File: timer.h
+ * -------------
+ * Host stand-in for the CS107E timer module, so hardware-free sources
+ * build natively for the tests. Tests that link code calling
+ * timer_get_ticks() define it themselves.
+ */
+
+#ifndef TIMER_H
+#define TIMER_H
+
+#define TICKS_PER_USEC 24
+
+unsigned long timer_get_ticks(void);
+
+#endif /* TIMER_H */
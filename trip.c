@@ -0,0 +1,206 @@
+/* File: trip.c
+ * ------------
+ * Trip computer with checkpointed lifetime totals (see trip.h).
+ */
+
+#include "trip.h"
+#include "checksum.h"
+#include "speed.h"
+#include "timer.h"
+#include "printf.h"
+#include "assert.h"
+#include <stddef.h>
+
+#define TRIP_MAGIC     0x50495254   // "TRIP"
+#define TRIP_VERSION   1
+#define TICKS_PER_SEC  (1000000UL * TICKS_PER_USEC)
+#define TICKS_PER_MS   (1000UL * TICKS_PER_USEC)
+
+// persistent record, kept small: 28 bytes
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t checksum;      // Fletcher-16 over the record with this field 0
+    uint32_t seq;           // newer record has the higher seq
+    uint32_t odometer_m;
+    uint32_t moving_s;
+    uint32_t brake_events;
+    uint32_t max_kph_q16;
+} trip_record_t;
+
+static struct {
+    uint64_t um_per_pass;
+    const trip_storage_t *storage;
+    trip_record_t boot;         // lifetime totals as loaded at boot
+    uint32_t seq;               // of the newest record in storage
+    int next_slot;
+
+    // this trip
+    uint64_t distance_um;
+    uint64_t moving_ticks;
+    uint32_t max_kph_q16;
+    uint32_t brake_events;
+
+    bool have_reading;
+    uint32_t last_passes;
+    uint64_t last_ticks;
+    bool was_moving;
+    uint64_t last_checkpoint;
+    bool dirty;                 // totals changed since the last checkpoint
+} module;
+
+static uint16_t record_checksum(const trip_record_t *rec) {
+    return checksum_record(rec, sizeof(*rec), offsetof(trip_record_t, checksum));
+}
+
+static bool record_valid(const trip_record_t *rec) {
+    return rec->magic == TRIP_MAGIC && rec->version == TRIP_VERSION &&
+           rec->checksum == record_checksum(rec);
+}
+
+static void record_clear(trip_record_t *rec) {
+    *rec = (trip_record_t){ .magic = TRIP_MAGIC, .version = TRIP_VERSION };
+}
+
+void trip_init(int magnets_per_wheel) {
+    assert(magnets_per_wheel >= 1);
+    module.um_per_pass = WHEEL_CIRC_UM / magnets_per_wheel;
+    module.storage = NULL;
+    record_clear(&module.boot);
+    module.seq = 0;
+    module.next_slot = 0;
+    module.distance_um = 0;
+    module.moving_ticks = 0;
+    module.max_kph_q16 = 0;
+    module.brake_events = 0;
+    module.have_reading = false;
+    module.was_moving = false;
+    module.last_checkpoint = timer_get_ticks();
+    module.dirty = false;
+}
+
+/* Loads the newest valid record from storage; totals then continue from it */
+void trip_set_storage(const trip_storage_t *storage) {
+    module.storage = storage;
+    record_clear(&module.boot);
+    module.seq = 0;
+    module.next_slot = 0;
+    if (!storage) return;
+
+    bool found = false;
+    for (int slot = 0; slot < TRIP_RECORD_SLOTS; slot++) {
+        trip_record_t rec;
+        if (!storage->read(slot, &rec, sizeof(rec)) || !record_valid(&rec)) continue;
+        // seq compare survives wraparound
+        if (!found || (int32_t)(rec.seq - module.seq) > 0) {
+            module.boot = rec;
+            module.seq = rec.seq;
+            module.next_slot = (slot + 1) % TRIP_RECORD_SLOTS;
+            found = true;
+        }
+    }
+}
+
+/* Folds in one speed_service reading: O(1), no divides */
+void trip_update(const speed_reading_t *reading) {
+    bool moving = !reading->stopped;
+    if (module.have_reading) {
+        // passes can only go back if the speed service was reconfigured
+        if (reading->revolutions > module.last_passes) {
+            module.distance_um += (uint64_t)(reading->revolutions - module.last_passes) * module.um_per_pass;
+            module.dirty = true;
+        }
+        if (moving && module.was_moving) {
+            module.moving_ticks += reading->now_ticks - module.last_ticks;
+        }
+    }
+    if (moving && !reading->decaying && reading->kph_q16 > module.max_kph_q16) {
+        module.max_kph_q16 = reading->kph_q16;
+        module.dirty = true;
+    }
+
+    bool stopped_now = module.was_moving && !moving;
+    module.have_reading = true;
+    module.last_passes = reading->revolutions;
+    module.last_ticks = reading->now_ticks;
+    module.was_moving = moving;
+
+    if (stopped_now ||
+        (moving && reading->now_ticks - module.last_checkpoint >= TRIP_CHECKPOINT_MS * TICKS_PER_MS)) {
+        trip_checkpoint();
+    }
+}
+
+void trip_note_brake(void) {
+    module.brake_events++;
+    module.dirty = true;
+}
+
+static void lifetime_record(trip_record_t *rec) {
+    *rec = module.boot;
+    rec->odometer_m += module.distance_um / 1000000;
+    rec->moving_s += module.moving_ticks / TICKS_PER_SEC;
+    rec->brake_events += module.brake_events;
+    if (module.max_kph_q16 > rec->max_kph_q16) rec->max_kph_q16 = module.max_kph_q16;
+}
+
+/* Writes lifetime totals if they changed; false if there is no storage or the write failed */
+bool trip_checkpoint(void) {
+    module.last_checkpoint = timer_get_ticks();
+    if (!module.storage || !module.dirty) return false;
+
+    trip_record_t rec;
+    lifetime_record(&rec);
+    rec.seq = module.seq + 1;
+    rec.checksum = record_checksum(&rec);
+    if (!module.storage->write(module.next_slot, &rec, sizeof(rec))) return false;
+
+    module.seq = rec.seq;
+    module.next_slot = (module.next_slot + 1) % TRIP_RECORD_SLOTS;
+    module.dirty = false;
+    return true;
+}
+
+static uint32_t average_kph_q16(uint64_t distance_um, uint64_t moving_ticks) {
+    uint64_t moving_ms = moving_ticks / TICKS_PER_MS;
+    if (moving_ms == 0) return 0;
+    // um/ms is mm/s; 1 mm/s = 0.0036 kph
+    uint64_t mm_s_q8 = (distance_um << 8) / moving_ms;
+    uint64_t avg = mm_s_q8 * 9 * 256 / 2500;
+    return (avg > UINT32_MAX) ? UINT32_MAX : (uint32_t)avg;
+}
+
+void trip_current(trip_summary_t *summary) {
+    summary->distance_m = module.distance_um / 1000000;
+    summary->moving_s = module.moving_ticks / TICKS_PER_SEC;
+    summary->max_kph_q16 = module.max_kph_q16;
+    summary->avg_kph_q16 = average_kph_q16(module.distance_um, module.moving_ticks);
+    summary->brake_events = module.brake_events;
+}
+
+void trip_lifetime(trip_summary_t *summary) {
+    trip_record_t rec;
+    lifetime_record(&rec);
+    summary->distance_m = rec.odometer_m;
+    summary->moving_s = rec.moving_s;
+    summary->max_kph_q16 = rec.max_kph_q16;
+    summary->avg_kph_q16 = average_kph_q16((uint64_t)rec.odometer_m * 1000000,
+                                           (uint64_t)rec.moving_s * TICKS_PER_SEC);
+    summary->brake_events = rec.brake_events;
+}
+
+static void print_summary(const char *label, const trip_summary_t *s) {
+    printf("%s: %d m, %d:%02d moving, max %d.%d kph, avg %d.%d kph, %d brake events\n",
+           label, s->distance_m, s->moving_s / 60, s->moving_s % 60,
+           speed_q16_whole(s->max_kph_q16), speed_q16_tenths(s->max_kph_q16),
+           speed_q16_whole(s->avg_kph_q16), speed_q16_tenths(s->avg_kph_q16),
+           s->brake_events);
+}
+
+void trip_print(void) {
+    trip_summary_t summary;
+    trip_current(&summary);
+    print_summary("trip", &summary);
+    trip_lifetime(&summary);
+    print_summary("total", &summary);
+}
@@ -0,0 +1,55 @@
+/* File: trip.h
+ * ------------
+ * Trip computer: distance, moving time, max/average speed and brake counts.
+ *
+ * trip_update() takes each speed_service reading. Distance comes from the
+ * count of magnet passes (each is WHEEL_CIRC_UM / magnets), so passes
+ * drained several at a time are never lost; moving time adds up the time
+ * between readings while the wheel is not stopped. Everything is integer
+ * and O(1) per call; average speed is only worked out when asked for.
+ *
+ * Lifetime totals (odometer, moving time, brake events, top speed) are
+ * checkpointed to persistent storage as a small checksummed record. The
+ * board support has no storage driver of its own, so the caller supplies
+ * one through trip_set_storage() (bike_demo.c passes record_store.h's
+ * trip slots, which for now are RAM: see there). Records alternate between two slots and
+ * the newest valid one wins on load, so a power cut during a write loses
+ * at most one checkpoint. Without storage the trip still works, it just
+ * starts from zero on every boot.
+ */
+
+#ifndef TRIP_H
+#define TRIP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "speed_service.h"
+
+#define TRIP_CHECKPOINT_MS   60000   // while moving; also on every stop
+#define TRIP_RECORD_SLOTS    2
+
+typedef struct {
+    // read or write one record slot; false on failure
+    bool (*read)(int slot, void *buf, size_t len);
+    bool (*write)(int slot, const void *buf, size_t len);
+} trip_storage_t;
+
+typedef struct {
+    uint32_t distance_m;
+    uint32_t moving_s;
+    uint32_t max_kph_q16;
+    uint32_t avg_kph_q16;       // distance over moving time
+    uint32_t brake_events;
+} trip_summary_t;
+
+void trip_init(int magnets_per_wheel);
+void trip_set_storage(const trip_storage_t *storage);
+void trip_update(const speed_reading_t *reading);
+void trip_note_brake(void);
+bool trip_checkpoint(void);
+void trip_current(trip_summary_t *summary);
+void trip_lifetime(trip_summary_t *summary);
+void trip_print(void);
+
+#endif /* TRIP_H */
@@ -0,0 +1,533 @@
+/* File: vl53l0x.c
+ * ---------------
+ * VL53L0X bring-up and interrupt-signalled continuous ranging (see vl53l0x.h).
+ */
+
+#include "vl53l0x.h"
+#include "i2c.h"
+#include "gpio_extra.h"
+#include "gpio_interrupt.h"
+#include "timer.h"
+#include "assert.h"
+#include <stddef.h>
+
+#define VL53L0X_ADDR 0x29
+
+/* Registers */
+#define REG_SYSRANGE_START                 0x00
+#define REG_SYSTEM_SEQUENCE_CONFIG         0x01
+#define REG_SYSTEM_INTERRUPT_CONFIG_GPIO   0x0A
+#define REG_SYSTEM_INTERRUPT_CLEAR         0x0B
+#define REG_RESULT_INTERRUPT_STATUS        0x13
+#define REG_RESULT_RANGE_STATUS            0x14
+#define REG_ALGO_PHASECAL_CONFIG_TIMEOUT   0x30
+#define REG_ALGO_PHASECAL_LIM              0x30    // on page 1
+#define REG_GLOBAL_CONFIG_VCSEL_WIDTH      0x32
+#define REG_FINAL_RANGE_MIN_COUNT_RATE_RTN_LIMIT 0x44
+#define REG_MSRC_CONFIG_TIMEOUT_MACROP     0x46
+#define REG_FINAL_RANGE_CONFIG_VALID_PHASE_LOW  0x47
+#define REG_FINAL_RANGE_CONFIG_VALID_PHASE_HIGH 0x48
+#define REG_DYNAMIC_SPAD_NUM_REQUESTED_REF_SPAD  0x4E
+#define REG_DYNAMIC_SPAD_REF_EN_START_OFFSET     0x4F
+#define REG_PRE_RANGE_CONFIG_VCSEL_PERIOD  0x50
+#define REG_PRE_RANGE_CONFIG_TIMEOUT_MACROP_HI  0x51
+#define REG_PRE_RANGE_CONFIG_VALID_PHASE_LOW    0x56
+#define REG_PRE_RANGE_CONFIG_VALID_PHASE_HIGH   0x57
+#define REG_MSRC_CONFIG_CONTROL            0x60
+#define REG_FINAL_RANGE_CONFIG_VCSEL_PERIOD     0x70
+#define REG_FINAL_RANGE_CONFIG_TIMEOUT_MACROP_HI 0x71
+#define REG_GPIO_HV_MUX_ACTIVE_HIGH        0x84
+#define REG_VHV_CONFIG_PAD_SCL_SDA_EXTSUP_HV 0x89
+#define REG_GLOBAL_CONFIG_SPAD_ENABLES_REF_0 0xB0
+#define REG_GLOBAL_CONFIG_REF_EN_START_SELECT 0xB6
+#define REG_IDENTIFICATION_MODEL_ID        0xC0
+
+#define EXPECTED_MODEL_ID  0xEE
+
+/* Values */
+#define SYSRANGE_SINGLESHOT     0x01
+#define SYSRANGE_BACK_TO_BACK   0x02
+#define SYSRANGE_VHV_INIT       0x40
+#define SEQUENCE_VHV_CAL        0x01
+#define SEQUENCE_PHASE_CAL      0x02
+#define SEQUENCE_DSS_PRE_FINAL  0xE8    // DSS, pre-range and final range; TCC and MSRC off
+#define INTERRUPT_NEW_SAMPLE    0x04
+#define GPIO_ACTIVE_HIGH        0x10
+#define MSRC_PRE_RANGE_LIMITS_OFF 0x12  // signal rate checks on MSRC and pre-range
+#define SIGNAL_RATE_LIMIT_Q9_7  32      // final range return rate limit, 0.25 MCPS
+#define RANGE_STATUS_VALID      11      // device range status field of RESULT_RANGE_STATUS
+#define REF_SPAD_COUNT          48
+#define VALID_PHASE_LOW         0x08
+
+/* Fixed per-step overheads in the timing budget, usec (from ST's API) */
+#define START_OVERHEAD_US       1910
+#define END_OVERHEAD_US         960
+#define DSS_OVERHEAD_US         690
+#define PRE_RANGE_OVERHEAD_US   660
+#define FINAL_RANGE_OVERHEAD_US 550
+
+typedef struct {
+    uint8_t reg;
+    uint8_t val;
+} reg_val_t;
+
+/* ST's default tuning settings, written once by static init */
+static const reg_val_t DEFAULT_TUNING[] = {
+    {0xFF, 0x01}, {0x00, 0x00}, {0xFF, 0x00}, {0x09, 0x00}, {0x10, 0x00}, {0x11, 0x00},
+    {0x24, 0x01}, {0x25, 0xFF}, {0x75, 0x00}, {0xFF, 0x01}, {0x4E, 0x2C}, {0x48, 0x00},
+    {0x30, 0x20}, {0xFF, 0x00}, {0x30, 0x09}, {0x54, 0x00}, {0x31, 0x04}, {0x32, 0x03},
+    {0x40, 0x83}, {0x46, 0x25}, {0x60, 0x00}, {0x27, 0x00}, {0x50, 0x06}, {0x51, 0x00},
+    {0x52, 0x96}, {0x56, 0x08}, {0x57, 0x30}, {0x61, 0x00}, {0x62, 0x00}, {0x64, 0x00},
+    {0x65, 0x00}, {0x66, 0xA0}, {0xFF, 0x01}, {0x22, 0x32}, {0x47, 0x14}, {0x49, 0xFF},
+    {0x4A, 0x00}, {0xFF, 0x00}, {0x7A, 0x0A}, {0x7B, 0x00}, {0x78, 0x21}, {0xFF, 0x01},
+    {0x23, 0x34}, {0x42, 0x00}, {0x44, 0xFF}, {0x45, 0x26}, {0x46, 0x05}, {0x40, 0x40},
+    {0x0E, 0x06}, {0x20, 0x1A}, {0x43, 0x40}, {0xFF, 0x00}, {0x34, 0x03}, {0x35, 0x44},
+    {0xFF, 0x01}, {0x31, 0x04}, {0x4B, 0x09}, {0x4C, 0x05}, {0x4D, 0x04}, {0xFF, 0x00},
+    {0x44, 0x00}, {0x45, 0x20}, {0x47, 0x08}, {0x48, 0x28}, {0x67, 0x00}, {0x70, 0x04},
+    {0x71, 0x01}, {0x72, 0xFE}, {0x76, 0x00}, {0x77, 0x00}, {0xFF, 0x01}, {0x0D, 0x01},
+    {0xFF, 0x00}, {0x80, 0x01}, {0x01, 0xF8}, {0xFF, 0x01}, {0x8E, 0x01}, {0x00, 0x01},
+    {0xFF, 0x00}, {0x80, 0x00},
+};
+
+/*
+ * Timing registers. Step timeouts count macro periods (mclks), whose
+ * length depends on the VCSEL period of the step; the final range timeout
+ * includes the pre-range one.
+ */
+typedef struct {
+    uint8_t pre_vcsel;          // VCSEL periods in pclks
+    uint8_t final_vcsel;
+    uint8_t msrc_timeout;       // MSRC_CONFIG_TIMEOUT_MACROP: mclks - 1
+    uint16_t pre_timeout;       // encoded mclks (see encode_timeout())
+    uint16_t final_timeout;
+} timing_regs_t;
+
+/*
+ * Worked out ahead of time with compute_timing() from the MSRC and
+ * pre-range timeouts the tuning table sets (38 and 151 mclks at 14
+ * pclks). ST keeps the default VCSEL periods for all three, so switching
+ * between them while ranging is one register write and no arithmetic.
+ */
+static const struct {
+    unsigned int budget_us;
+    timing_regs_t regs;
+} PRESETS[VL53L0X_PRESET_COUNT] = {
+    [VL53L0X_HIGH_SPEED]    = {  20000, { 14, 10, 0x25, 0x0096, 0x00D5 } },
+    [VL53L0X_DEFAULT]       = {  33000, { 14, 10, 0x25, 0x0096, 0x028A } },
+    [VL53L0X_HIGH_ACCURACY] = { 200000, { 14, 10, 0x25, 0x0096, 0x059A } },
+};
+
+/* Phase check limits and calibration settings per VCSEL period */
+static const uint8_t PRE_VALID_PHASE_HIGH[] = { 0x18, 0x30, 0x40, 0x50 };    // 12, 14, 16, 18 pclks
+typedef struct {
+    uint8_t valid_phase_high;
+    uint8_t vcsel_width;
+    uint8_t phasecal_timeout;
+    uint8_t phasecal_lim;
+} final_vcsel_t;
+
+static const final_vcsel_t FINAL_VCSEL_SETTINGS[] = {
+    { 0x10, 0x02, 0x0C, 0x30 },     // 8 pclks
+    { 0x28, 0x03, 0x09, 0x20 },     // 10
+    { 0x38, 0x03, 0x08, 0x20 },     // 12
+    { 0x48, 0x03, 0x07, 0x20 },     // 14
+};
+
+static struct {
+    i2c_device_t *dev;
+    gpio_id_t gpio1;
+    uint8_t stop_variable;          // read at data init, needed to start and stop ranging
+    volatile bool ready;            // set by the GPIO1 handler, cleared by vl53l0x_read()
+    volatile unsigned long ready_ticks;
+    volatile uint32_t seq;
+    uint32_t discard_seq;           // samples up to this one straddle a timing change
+    bool ranging;
+    timing_regs_t timing;           // as written to the sensor
+    unsigned int budget_us;
+} module;
+
+static bool write_reg(uint8_t reg, uint8_t val) {
+    return i2c_write_reg(module.dev, reg, val);
+}
+
+static bool write_reg16(uint8_t reg, uint16_t val) {
+    uint8_t bytes[2] = { val >> 8, val & 0xff };   // big-endian
+    return i2c_write_reg_n(module.dev, reg, bytes, 2);
+}
+
+static bool read_reg(uint8_t reg, uint8_t *val) {
+    return i2c_read_reg_n(module.dev, reg, val, 1);
+}
+
+static bool read_reg16(uint8_t reg, uint16_t *val) {
+    uint8_t bytes[2];
+    if (!i2c_read_reg_n(module.dev, reg, bytes, 2)) return false;
+    *val = (bytes[0] << 8) | bytes[1];
+    return true;
+}
+
+static bool update_reg(uint8_t reg, uint8_t clear, uint8_t set) {
+    uint8_t val;
+    return read_reg(reg, &val) && write_reg(reg, (val & ~clear) | set);
+}
+
+static bool write_table(const reg_val_t *table, int n) {
+    for (int i = 0; i < n; i++) {
+        if (!write_reg(table[i].reg, table[i].val)) return false;
+    }
+    return true;
+}
+
+/* Waits until (reg & mask) is nonzero, or zero if want_set is false; false on timeout */
+static bool wait_reg_ms(uint8_t reg, uint8_t mask, bool want_set, unsigned int timeout_ms) {
+    unsigned long start = timer_get_ticks();
+    while (true) {
+        uint8_t val;
+        if (!read_reg(reg, &val)) return false;
+        if (((val & mask) != 0) == want_set) return true;
+        if (timer_get_ticks() - start > timeout_ms * 1000UL * TICKS_PER_USEC) return false;
+    }
+}
+
+static bool wait_reg(uint8_t reg, uint8_t mask, bool want_set) {
+    return wait_reg_ms(reg, mask, want_set, VL53L0X_TIMEOUT_MS);
+}
+
+/* Register page dance around the stop variable (0x91), as in ST's API */
+static bool write_stop_variable(uint8_t val) {
+    return write_reg(0x80, 0x01) && write_reg(0xFF, 0x01) && write_reg(0x00, 0x00) &&
+           write_reg(0x91, val) &&
+           write_reg(0x00, 0x01) && write_reg(0xFF, 0x00) && write_reg(0x80, 0x00);
+}
+
+static bool data_init(void) {
+    // 2V8 I/O, standard mode I2C
+    if (!update_reg(REG_VHV_CONFIG_PAD_SCL_SDA_EXTSUP_HV, 0, 0x01)) return false;
+    bool ok = write_reg(0x88, 0x00) &&
+              write_reg(0x80, 0x01) && write_reg(0xFF, 0x01) && write_reg(0x00, 0x00) &&
+              read_reg(0x91, &module.stop_variable) &&
+              write_reg(0x00, 0x01) && write_reg(0xFF, 0x00) && write_reg(0x80, 0x00);
+    if (!ok) return false;
+    return update_reg(REG_MSRC_CONFIG_CONTROL, 0, MSRC_PRE_RANGE_LIMITS_OFF) &&
+           write_reg16(REG_FINAL_RANGE_MIN_COUNT_RATE_RTN_LIMIT, SIGNAL_RATE_LIMIT_Q9_7) &&
+           write_reg(REG_SYSTEM_SEQUENCE_CONFIG, 0xFF);
+}
+
+/* Reference SPAD count and type from the sensor's NVM */
+static bool get_spad_info(uint8_t *count, bool *type_is_aperture) {
+    bool ok = write_reg(0x80, 0x01) && write_reg(0xFF, 0x01) && write_reg(0x00, 0x00) &&
+              write_reg(0xFF, 0x06) && update_reg(0x83, 0, 0x04) &&
+              write_reg(0xFF, 0x07) && write_reg(0x81, 0x01) && write_reg(0x80, 0x01) &&
+              write_reg(0x94, 0x6b) && write_reg(0x83, 0x00) &&
+              wait_reg(0x83, 0xFF, true) &&
+              write_reg(0x83, 0x01);
+    uint8_t info;
+    ok = ok && read_reg(0x92, &info);
+    ok = ok && write_reg(0x81, 0x00) && write_reg(0xFF, 0x06) && update_reg(0x83, 0x04, 0) &&
+         write_reg(0xFF, 0x01) && write_reg(0x00, 0x01) && write_reg(0xFF, 0x00) && write_reg(0x80, 0x00);
+    if (!ok) return false;
+    *count = info & 0x7f;
+    *type_is_aperture = (info >> 7) & 0x01;
+    return true;
+}
+
+/* Enables the first `count` good reference SPADs of the right type */
+static bool set_ref_spads(void) {
+    uint8_t count;
+    bool aperture;
+    uint8_t map[REF_SPAD_COUNT / 8];
+    if (!get_spad_info(&count, &aperture)) return false;
+    if (!i2c_read_reg_n(module.dev, REG_GLOBAL_CONFIG_SPAD_ENABLES_REF_0, map, sizeof(map))) return false;
+
+    bool ok = write_reg(0xFF, 0x01) &&
+              write_reg(REG_DYNAMIC_SPAD_REF_EN_START_OFFSET, 0x00) &&
+              write_reg(REG_DYNAMIC_SPAD_NUM_REQUESTED_REF_SPAD, 0x2C) &&
+              write_reg(0xFF, 0x00) &&
+              write_reg(REG_GLOBAL_CONFIG_REF_EN_START_SELECT, 0xB4);
+    if (!ok) return false;
+
+    int first = aperture ? 12 : 0;  // aperture SPADs start at 12
+    int enabled = 0;
+    for (int i = 0; i < REF_SPAD_COUNT; i++) {
+        uint8_t bit = 1 << (i % 8);
+        if (i < first || enabled == count) {
+            map[i / 8] &= ~bit;
+        } else if (map[i / 8] & bit) {
+            enabled++;
+        }
+    }
+    return i2c_write_reg_n(module.dev, REG_GLOBAL_CONFIG_SPAD_ENABLES_REF_0, map, sizeof(map));
+}
+
+static bool static_init(void) {
+    if (!set_ref_spads()) return false;
+    if (!write_table(DEFAULT_TUNING, sizeof(DEFAULT_TUNING) / sizeof(DEFAULT_TUNING[0]))) return false;
+    // GPIO1 on new sample ready, active low
+    return write_reg(REG_SYSTEM_INTERRUPT_CONFIG_GPIO, INTERRUPT_NEW_SAMPLE) &&
+           update_reg(REG_GPIO_HV_MUX_ACTIVE_HIGH, GPIO_ACTIVE_HIGH, 0) &&
+           write_reg(REG_SYSTEM_INTERRUPT_CLEAR, 0x01) &&
+           write_reg(REG_SYSTEM_SEQUENCE_CONFIG, SEQUENCE_DSS_PRE_FINAL);
+}
+
+/* One calibration run with the sensor idle; polls (bounded), it's only at setup */
+static bool single_ref_calibration(uint8_t sequence, uint8_t vhv_init) {
+    return write_reg(REG_SYSTEM_SEQUENCE_CONFIG, sequence) &&
+           write_reg(REG_SYSRANGE_START, SYSRANGE_SINGLESHOT | vhv_init) &&
+           wait_reg(REG_RESULT_INTERRUPT_STATUS, 0x07, true) &&
+           write_reg(REG_SYSTEM_INTERRUPT_CLEAR, 0x01) &&
+           write_reg(REG_SYSRANGE_START, 0x00);
+}
+
+/*
+ * Temperature calibration needs to be run again if the temperature changes
+ * by more than 8 degrees according to the datasheet.
+ */
+static bool ref_calibration(void) {
+    return single_ref_calibration(SEQUENCE_VHV_CAL, SYSRANGE_VHV_INIT) &&
+           single_ref_calibration(SEQUENCE_PHASE_CAL, 0) &&
+           write_reg(REG_SYSTEM_SEQUENCE_CONFIG, SEQUENCE_DSS_PRE_FINAL);
+}
+
+/*
+ * Timing arithmetic (as in ST's API)
+ * ----------------------------------
+ * A macro period is 2304 VCSEL periods of the 1.655 ns PLL clock.
+ * Timeouts are encoded as (lsb << msb) + 1 mclks, lsb and msb one byte each.
+ */
+static uint32_t macro_period_ns(int vcsel_pclks) {
+    return (2304UL * vcsel_pclks * 1655 + 500) / 1000;
+}
+
+static uint32_t mclks_to_us(uint32_t mclks, int vcsel_pclks) {
+    return ((uint64_t)mclks * macro_period_ns(vcsel_pclks) + 500) / 1000;
+}
+
+static uint32_t us_to_mclks(uint32_t us, int vcsel_pclks) {
+    uint32_t period_ns = macro_period_ns(vcsel_pclks);
+    return ((uint64_t)us * 1000 + period_ns / 2) / period_ns;
+}
+
+static uint32_t decode_timeout(uint16_t reg) {
+    return ((uint32_t)(reg & 0xff) << (reg >> 8)) + 1;
+}
+
+static uint16_t encode_timeout(uint32_t mclks) {
+    if (mclks == 0) return 0;
+    uint32_t lsb = mclks - 1;
+    int msb = 0;
+    while (lsb > 0xff) {
+        lsb >>= 1;
+        msb++;
+    }
+    return (msb << 8) | lsb;
+}
+
+/*
+ * Register values for a budget with the given VCSEL periods. The MSRC and
+ * pre-range steps keep their times from `from` (re-expressed in the new
+ * pre-range macro periods if that changes); the final range gets whatever
+ * the budget has left after every step and ST's overheads, for the
+ * SEQUENCE_DSS_PRE_FINAL sequence. False if the budget is too small.
+ */
+static bool compute_timing(const timing_regs_t *from, unsigned int budget_us,
+                           int pre_vcsel, int final_vcsel, timing_regs_t *to) {
+    *to = *from;
+    to->pre_vcsel = pre_vcsel;
+    to->final_vcsel = final_vcsel;
+    if (pre_vcsel != from->pre_vcsel) {
+        uint32_t msrc_us = mclks_to_us(from->msrc_timeout + 1, from->pre_vcsel);
+        uint32_t pre_us = mclks_to_us(decode_timeout(from->pre_timeout), from->pre_vcsel);
+        uint32_t msrc_mclks = us_to_mclks(msrc_us, pre_vcsel);
+        to->msrc_timeout = msrc_mclks > 256 ? 255 : msrc_mclks - 1;
+        to->pre_timeout = encode_timeout(us_to_mclks(pre_us, pre_vcsel));
+    }
+
+    uint32_t pre_mclks = decode_timeout(to->pre_timeout);
+    uint32_t msrc_us = mclks_to_us(to->msrc_timeout + 1, pre_vcsel);
+    uint32_t pre_us = mclks_to_us(pre_mclks, pre_vcsel);
+    uint32_t used_us = START_OVERHEAD_US + END_OVERHEAD_US +
+                       2 * (msrc_us + DSS_OVERHEAD_US) +
+                       pre_us + PRE_RANGE_OVERHEAD_US + FINAL_RANGE_OVERHEAD_US;
+    if (budget_us < VL53L0X_MIN_BUDGET_US || used_us > budget_us) return false;
+    uint32_t final_mclks = us_to_mclks(budget_us - used_us, final_vcsel) + pre_mclks;
+    to->final_timeout = encode_timeout(final_mclks);
+    return true;
+}
+
+static bool read_timing(timing_regs_t *t) {
+    uint8_t pre_vcsel, final_vcsel;
+    bool ok = read_reg(REG_PRE_RANGE_CONFIG_VCSEL_PERIOD, &pre_vcsel) &&
+              read_reg(REG_FINAL_RANGE_CONFIG_VCSEL_PERIOD, &final_vcsel) &&
+              read_reg(REG_MSRC_CONFIG_TIMEOUT_MACROP, &t->msrc_timeout) &&
+              read_reg16(REG_PRE_RANGE_CONFIG_TIMEOUT_MACROP_HI, &t->pre_timeout) &&
+              read_reg16(REG_FINAL_RANGE_CONFIG_TIMEOUT_MACROP_HI, &t->final_timeout);
+    t->pre_vcsel = (pre_vcsel + 1) << 1;
+    t->final_vcsel = (final_vcsel + 1) << 1;
+    return ok;
+}
+
+static bool write_pre_vcsel(int pclks) {
+    return write_reg(REG_PRE_RANGE_CONFIG_VALID_PHASE_HIGH, PRE_VALID_PHASE_HIGH[(pclks - 12) / 2]) &&
+           write_reg(REG_PRE_RANGE_CONFIG_VALID_PHASE_LOW, VALID_PHASE_LOW) &&
+           write_reg(REG_PRE_RANGE_CONFIG_VCSEL_PERIOD, (pclks >> 1) - 1);
+}
+
+static bool write_final_vcsel(int pclks) {
+    const final_vcsel_t *v = &FINAL_VCSEL_SETTINGS[(pclks - 8) / 2];
+    return write_reg(REG_FINAL_RANGE_CONFIG_VALID_PHASE_HIGH, v->valid_phase_high) &&
+           write_reg(REG_FINAL_RANGE_CONFIG_VALID_PHASE_LOW, VALID_PHASE_LOW) &&
+           write_reg(REG_GLOBAL_CONFIG_VCSEL_WIDTH, v->vcsel_width) &&
+           write_reg(REG_ALGO_PHASECAL_CONFIG_TIMEOUT, v->phasecal_timeout) &&
+           write_reg(0xFF, 0x01) && write_reg(REG_ALGO_PHASECAL_LIM, v->phasecal_lim) && write_reg(0xFF, 0x00) &&
+           write_reg(REG_FINAL_RANGE_CONFIG_VCSEL_PERIOD, (pclks >> 1) - 1);
+}
+
+/* Writes only the registers that differ; new VCSEL periods need a fresh phase calibration */
+static bool write_timing(const timing_regs_t *t) {
+    const timing_regs_t *cur = &module.timing;
+    bool pre_changed = t->pre_vcsel != cur->pre_vcsel;
+    bool final_changed = t->final_vcsel != cur->final_vcsel;
+    bool ok = (!pre_changed || write_pre_vcsel(t->pre_vcsel)) &&
+              (!final_changed || write_final_vcsel(t->final_vcsel)) &&
+              (t->msrc_timeout == cur->msrc_timeout || write_reg(REG_MSRC_CONFIG_TIMEOUT_MACROP, t->msrc_timeout)) &&
+              (t->pre_timeout == cur->pre_timeout || write_reg16(REG_PRE_RANGE_CONFIG_TIMEOUT_MACROP_HI, t->pre_timeout)) &&
+              (t->final_timeout == cur->final_timeout || write_reg16(REG_FINAL_RANGE_CONFIG_TIMEOUT_MACROP_HI, t->final_timeout));
+    if (!ok) return false;
+    module.timing = *t;
+    if (!pre_changed && !final_changed) return true;
+    return single_ref_calibration(SEQUENCE_PHASE_CAL, 0) &&
+           write_reg(REG_SYSTEM_SEQUENCE_CONFIG, SEQUENCE_DSS_PRE_FINAL);
+}
+
+/*
+ * Same VCSEL periods: the registers are written while ranging goes on,
+ * and the measurement in flight, which straddles the change, is dropped.
+ * New VCSEL periods need the sensor idle for the phase calibration, so
+ * ranging stops (waiting out the measurement in flight) and restarts.
+ */
+static bool apply_timing(const timing_regs_t *t, unsigned int budget_us) {
+    bool recalibrate = t->pre_vcsel != module.timing.pre_vcsel || t->final_vcsel != module.timing.final_vcsel;
+    bool was_ranging = module.ranging;
+    if (was_ranging && recalibrate) {
+        if (!vl53l0x_stop() || !write_reg(REG_SYSTEM_INTERRUPT_CLEAR, 0x01)) return false;
+        wait_reg_ms(REG_RESULT_INTERRUPT_STATUS, 0x07, true, module.budget_us / 1000 + VL53L0X_TIMEOUT_MS);
+        if (!write_reg(REG_SYSTEM_INTERRUPT_CLEAR, 0x01)) return false;
+    }
+    bool ok = write_timing(t);
+    if (ok) module.budget_us = budget_us;
+    if (was_ranging && recalibrate) {
+        ok = vl53l0x_start_continuous() && ok;
+    } else if (was_ranging) {
+        module.discard_seq = module.seq + 1;
+    }
+    return ok;
+}
+
+static void handle_gpio1(void *aux_data) {
+    unsigned long now = timer_get_ticks();  // stamp first, before anything else
+    gpio_interrupt_clear(module.gpio1);
+    module.ready_ticks = now;
+    module.seq++;
+    module.ready = true;    // published after the stamp
+}
+
+/* False if the sensor isn't there or doesn't come up */
+bool vl53l0x_init(gpio_id_t gpio1_pin) {
+    module.ready = false;
+    module.seq = 0;
+    module.discard_seq = 0;
+    module.ranging = false;
+    module.gpio1 = gpio1_pin;
+    if (!module.dev) module.dev = i2c_new(VL53L0X_ADDR);
+    if (!module.dev) return false;
+
+    uint8_t id;
+    if (!read_reg(REG_IDENTIFICATION_MODEL_ID, &id) || id != EXPECTED_MODEL_ID) return false;
+    if (!data_init() || !static_init() || !ref_calibration()) return false;
+    if (!read_timing(&module.timing) || !vl53l0x_set_preset(VL53L0X_DEFAULT)) return false;
+
+    gpio_set_input(gpio1_pin);
+    gpio_set_pullup(gpio1_pin);
+    gpio_interrupt_config(gpio1_pin, GPIO_INTERRUPT_NEGATIVE_EDGE, false);
+    gpio_interrupt_register_handler(gpio1_pin, handle_gpio1, NULL);
+    gpio_interrupt_enable(gpio1_pin);
+    return true;
+}
+
+/* Back-to-back ranging until vl53l0x_stop(); samples arrive via vl53l0x_read() */
+bool vl53l0x_start_continuous(void) {
+    assert(module.dev);
+    module.ready = false;
+    if (!write_stop_variable(module.stop_variable) ||
+        !write_reg(REG_SYSTEM_INTERRUPT_CLEAR, 0x01) ||
+        !write_reg(REG_SYSRANGE_START, SYSRANGE_BACK_TO_BACK)) return false;
+    module.discard_seq = module.seq;
+    module.ranging = true;
+    return true;
+}
+
+bool vl53l0x_stop(void) {
+    assert(module.dev);
+    module.ranging = false;
+    return write_reg(REG_SYSRANGE_START, SYSRANGE_SINGLESHOT) && write_stop_variable(0x00);
+}
+
+/* True if a finished measurement is waiting; no I2C */
+bool vl53l0x_sample_ready(void) {
+    return module.ready;
+}
+
+/*
+ * Returns false at once if no measurement has finished since the last
+ * call. Otherwise reads it (one 12-byte burst), clears the sensor's
+ * interrupt so GPIO1 can signal the next one, and returns true.
+ */
+bool vl53l0x_read(vl53l0x_sample_t *sample) {
+    if (!module.ready) return false;
+    module.ready = false;
+    sample->ticks = module.ready_ticks;
+    sample->seq = module.seq;
+
+    uint8_t result[12];
+    bool ok = i2c_read_reg_n(module.dev, REG_RESULT_RANGE_STATUS, result, sizeof(result));
+    // clear even after a failed read, or GPIO1 stays low and no edge ever comes again
+    ok = write_reg(REG_SYSTEM_INTERRUPT_CLEAR, 0x01) && ok;
+    if (!ok) return false;
+    if ((int32_t)(sample->seq - module.discard_seq) <= 0) return false;  // straddles a timing change
+
+    sample->range_mm = (result[10] << 8) | result[11];
+    sample->valid = ((result[0] & 0x78) >> 3) == RANGE_STATUS_VALID &&
+                    sample->range_mm < VL53L0X_OUT_OF_RANGE;
+    return true;
+}
+
+/* Switches to a preset's precomputed registers (see vl53l0x.h); fine while ranging */
+bool vl53l0x_set_preset(vl53l0x_preset_t preset) {
+    assert(preset < VL53L0X_PRESET_COUNT);
+    return apply_timing(&PRESETS[preset].regs, PRESETS[preset].budget_us);
+}
+
+/* Any budget from VL53L0X_MIN_BUDGET_US up, worked out on the spot; false if too small */
+bool vl53l0x_set_timing_budget(unsigned int budget_us) {
+    timing_regs_t t;
+    if (!compute_timing(&module.timing, budget_us, module.timing.pre_vcsel, module.timing.final_vcsel, &t)) return false;
+    return apply_timing(&t, budget_us);
+}
+
+/*
+ * pre-range 12-18 and final range 8-14 pclks, even. Longer periods reach
+ * further in the dark; the budget is kept, so the final range gets
+ * shorter or longer to make up. Recalibrates the phase, so while ranging
+ * this waits out the measurement in flight.
+ */
+bool vl53l0x_set_vcsel_periods(int pre_range_pclks, int final_range_pclks) {
+    if (pre_range_pclks < 12 || pre_range_pclks > 18 || pre_range_pclks % 2) return false;
+    if (final_range_pclks < 8 || final_range_pclks > 14 || final_range_pclks % 2) return false;
+    timing_regs_t t;
+    if (!compute_timing(&module.timing, module.budget_us, pre_range_pclks, final_range_pclks, &t)) return false;
+    return apply_timing(&t, module.budget_us);
+}
+
+unsigned int vl53l0x_timing_budget(void) {
+    return module.budget_us;
+}
@@ -0,0 +1,76 @@
+/* File: vl53l0x.h
+ * ---------------
+ * VL53L0X time-of-flight ranging sensor on I2C.
+ *
+ * Bring-up follows ST's API sequence (as in the Pololu and Artful Bytes
+ * drivers, see README): data init, reference SPAD setup, the default
+ * tuning table, then the VHV and phase reference calibrations. Every wait
+ * on the sensor is bounded by VL53L0X_TIMEOUT_MS, so a missing or stuck
+ * sensor makes vl53l0x_init() return false instead of hanging.
+ *
+ * Once vl53l0x_start_continuous() is called the sensor ranges back to
+ * back on its own. Each finished measurement pulls GPIO1 low; the falling
+ * edge raises a GPIO interrupt whose handler only stamps the time and
+ * flags the sample. The handler doesn't touch I2C: the main loop shares
+ * the bus with the accelerometer, and a transfer from interrupt context
+ * could land in the middle of one of its transactions. Instead
+ * vl53l0x_read() returns false at once until a sample is flagged, and
+ * then reads the result in one burst and clears the sensor's interrupt.
+ * Nobody polls the sensor's status registers over I2C.
+ *
+ * While GPIO1 is held low no further edge comes, so samples the caller
+ * doesn't collect in time are replaced by newer ones (seq shows the gap).
+ *
+ * Measurement timing: the timing budget is the time for one measurement,
+ * traded between rate and range noise. Three presets carry precomputed
+ * register values (ST's high-speed, default and high-accuracy modes);
+ * vl53l0x_init() leaves the sensor on VL53L0X_DEFAULT. They share the
+ * default VCSEL (laser pulse) periods, so switching among them is a
+ * single register write that can happen while ranging, e.g. as the bike
+ * speeds up; the one measurement straddling the change is dropped. Any
+ * other budget, or other VCSEL periods, is worked out at runtime;
+ * changing VCSEL periods also redoes the phase calibration, which
+ * stops ranging for up to one measurement.
+ *
+ * Call i2c_init(), interrupts_init() and gpio_interrupt_init() before
+ * vl53l0x_init(), and interrupts_global_enable() after.
+ */
+
+#ifndef VL53L0X_H
+#define VL53L0X_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "gpio.h"
+
+#define VL53L0X_GPIO1_PIN     GPIO_PB7   // open drain, active low, pulled up on the breakout
+#define VL53L0X_TIMEOUT_MS    100        // longest any single wait on the sensor may take
+#define VL53L0X_OUT_OF_RANGE  8190       // range reported when nothing is in view
+#define VL53L0X_MIN_BUDGET_US 20000
+
+typedef enum {
+    VL53L0X_HIGH_SPEED = 0,     // 20 ms budget: ~50 samples/s, +/-5% range
+    VL53L0X_DEFAULT,            // 33 ms
+    VL53L0X_HIGH_ACCURACY,      // 200 ms: ~5 samples/s, +/-3% range
+    VL53L0X_PRESET_COUNT
+} vl53l0x_preset_t;
+
+typedef struct {
+    uint16_t range_mm;
+    bool valid;             // sensor's range status says the range is good
+    unsigned long ticks;    // timer ticks when GPIO1 signalled completion
+    uint32_t seq;           // completions signalled so far, including this one
+} vl53l0x_sample_t;
+
+bool vl53l0x_init(gpio_id_t gpio1_pin);
+bool vl53l0x_start_continuous(void);
+bool vl53l0x_stop(void);
+bool vl53l0x_read(vl53l0x_sample_t *sample);
+bool vl53l0x_sample_ready(void);
+
+bool vl53l0x_set_preset(vl53l0x_preset_t preset);
+bool vl53l0x_set_timing_budget(unsigned int budget_us);
+bool vl53l0x_set_vcsel_periods(int pre_range_pclks, int final_range_pclks);
+unsigned int vl53l0x_timing_budget(void);
+
+#endif /* VL53L0X_H */